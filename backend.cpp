@@ -0,0 +1,24 @@
+#include "backend.hpp"
+#include <cassert>
+#include <stdexcept>
+
+using namespace std;
+
+shared_ptr<Backend> Backend::Create(Kind kind)
+{
+    switch (kind)
+    {
+    case Backend::EV3:
+        return make_shared<detail::Ev3Backend>();
+
+    case Backend::SIM:
+        return make_shared<detail::SimBackend>();
+
+    case Backend::REPLAY:
+        throw invalid_argument("kind: a replay backend needs a trace, see detail::ReplayBackend");
+
+    default:
+        assert(false && "missing implementation backend kind");
+        return nullptr;
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "rubiks.hpp"
+#include "sysfs.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+// Mechanical calibration of the cube crawler (in motor degrees), shared by the device and the simulator
+namespace mechanics {
+
+constexpr int BEAM_HOME = -35;      // rest position, relative to the stalled home position
+constexpr int BEAM_ENGAGE = -215;   // from rest to holding the top two layers of the cube
+constexpr int BEAM_PULL = 60;       // from engaged to the cube tipped over (flipped)
+constexpr int TABLE_QUARTER = 270;  // per quarter turn of the table (3:1 gearing)
+constexpr int SCANNER_CENTER = -720; // color sensor above the center cell
+constexpr int SCANNER_EDGE = -600;   // color sensor above the side center cells
+constexpr int SCANNER_CORNER = -560; // color sensor above the corner cells (table at 45 degrees)
+constexpr int SCANNER_RING = -580;   // color sensor passes over both side centers and corners as the table turns
+
+} // namespace mechanics
+
+// The hardware of the cube crawler as seen by 'Device'
+//
+// A backend exposes the motor and sensor operations the device needs, and also owns time: 'now' and 'sleep_for'
+// are the backend's, so a simulator can run on a virtual clock and play a full scramble/solve in milliseconds.
+//
+struct Backend {
+
+    enum Kind {
+        EV3, // The real thing, driven through sysfs
+        SIM, // Models the mechanics and a virtual cube, runs on a virtual clock
+        REPLAY // Plays back a recorded session, see trace.hpp
+    };
+    enum Motor : int { BEAM, TURNTABLE, SCANNER };
+    enum Sensor : int { BUTTON, COLOR, CUBE };
+    enum State : int { RUNNING = 1, RAMPING = 2, HOLDING = 4, OVERLOADED = 8, STALLED = 16 };
+    using Duration = std::chrono::microseconds;
+
+    static auto Create(Kind kind) -> std::shared_ptr<Backend>;
+    virtual ~Backend() = default;
+
+    virtual auto kind() const -> Kind = 0;
+
+    /*
+        Queries:
+    */
+
+    virtual bool connected(Motor motor) const = 0;
+    virtual bool connected(Sensor sensor) const = 0;
+    virtual auto state(Motor motor) -> int = 0; // bitwise or of State flags
+    virtual auto position(Motor motor) -> int = 0;
+    virtual auto value(Sensor sensor, std::size_t index = 0) -> int = 0;
+    virtual auto now() -> Duration = 0; // time since the backend was created
+
+    /*
+        Commands:
+    */
+
+    virtual void reset(Motor motor) = 0;
+    virtual void stop(Motor motor) = 0;
+    virtual void run_forever(Motor motor) = 0;
+    virtual void run_to_rel_pos(Motor motor) = 0;
+    virtual void set_stop_action(Motor motor, std::string const &action) = 0;
+    virtual void set_speed_sp(Motor motor, int speed) = 0;
+    virtual void set_position_sp(Motor motor, int position) = 0;
+    virtual void set_mode(Sensor sensor, std::string const &mode) = 0;
+    virtual void sleep_for(Duration duration) = 0;
+    virtual void speak(std::string const &msg) = 0;
+};
+
+namespace detail {
+
+class Ev3Backend final : public Backend
+{
+  public:
+    explicit Ev3Backend(std::string const &class_dir = sysfs::CLASS_DIR);
+
+    auto kind() const -> Kind override { return EV3; }
+
+    bool connected(Motor motor) const override;
+    bool connected(Sensor sensor) const override;
+    auto state(Motor motor) -> int override;
+    auto position(Motor motor) -> int override;
+    auto value(Sensor sensor, std::size_t index = 0) -> int override;
+    auto now() -> Duration override;
+
+    void reset(Motor motor) override;
+    void stop(Motor motor) override;
+    void run_forever(Motor motor) override;
+    void run_to_rel_pos(Motor motor) override;
+    void set_stop_action(Motor motor, std::string const &action) override;
+    void set_speed_sp(Motor motor, int speed) override;
+    void set_position_sp(Motor motor, int position) override;
+    void set_mode(Sensor sensor, std::string const &mode) override;
+    void sleep_for(Duration duration) override;
+    void speak(std::string const &msg) override;
+
+  private:
+    sysfs::Sensor _sensors[3];
+    sysfs::Motor _motors[3];
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Simulated cube crawler
+//
+// Motors run at their speed setpoint (plus a fixed ramp time) on a virtual clock. Every access to the backend takes
+// a little virtual time too, as sysfs accesses do on the brick. The beam stalls at its home position, and the table
+// stalls (counted as a fault) when the beam hangs over the cube without holding it. A virtual cube, in device
+// coordinates, follows the mechanics: the beam flips it when pulled back from holding, and the table rotates it, or
+// only turns its bottom layer while the beam holds the top two.
+//
+class SimBackend final : public Backend
+{
+  public:
+    struct Stats {
+        std::uint64_t accesses = 0;
+        std::uint64_t commands = 0;
+        std::uint64_t flips = 0;
+        std::uint64_t quarter_turns = 0;
+        std::uint64_t faults = 0;
+    };
+
+    explicit SimBackend(Rubiks const &cube = Rubiks(), unsigned seed = 0);
+
+    auto kind() const -> Kind override { return SIM; }
+
+    bool connected(Motor motor) const override;
+    bool connected(Sensor sensor) const override;
+    auto state(Motor motor) -> int override;
+    auto position(Motor motor) -> int override;
+    auto value(Sensor sensor, std::size_t index = 0) -> int override;
+    auto now() -> Duration override;
+
+    void reset(Motor motor) override;
+    void stop(Motor motor) override;
+    void run_forever(Motor motor) override;
+    void run_to_rel_pos(Motor motor) override;
+    void set_stop_action(Motor motor, std::string const &action) override;
+    void set_speed_sp(Motor motor, int speed) override;
+    void set_position_sp(Motor motor, int position) override;
+    void set_mode(Sensor sensor, std::string const &mode) override;
+    void sleep_for(Duration duration) override;
+    void speak(std::string const &msg) override;
+
+    // The virtual cube, in device coordinates (Rubiks::LEFT is the device's LEFT, etc.)
+    auto cube() const -> Rubiks;
+    auto stats() const -> Stats;
+
+  private:
+    enum Mode { IDLE, RUN_TO, FOREVER };
+    struct SimMotor {
+        double position = 0.0; // tacho counter
+        double offset = 0.0;   // physical angle = position + offset
+        int speed_sp = 0;
+        int position_sp = 0;
+        std::string stop_action = "coast";
+        Mode mode = IDLE;
+        double target = 0.0;
+        Duration ramp_until{0};
+        bool stalled = false;
+    };
+
+    void access(bool command);
+    void advance(Duration duration);
+    void step(double dt_us);
+    void move_beam(double from, double to);
+    void move_table(double from, double to);
+    auto sensed() const -> int; // position of the nibble under the color sensor, -1 if none
+
+    mutable std::mutex _mutex;
+    Duration _clock;
+    SimMotor _motors[3];
+    std::string _modes[3];
+    Rubiks _cube;
+    bool _engaged;
+    int _quarters;
+    std::mt19937 _noise;
+    Stats _stats;
+};
+
+} // namespace detail
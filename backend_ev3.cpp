@@ -0,0 +1,63 @@
+#include "backend.hpp"
+#include <thread>
+
+#ifdef CRAWLER_HOST
+#include <iostream>
+#else
+#include "ev3dev.h"
+#endif
+
+using namespace std;
+
+namespace detail {
+
+Ev3Backend::Ev3Backend(string const &class_dir)
+    : _sensors{{sysfs::INPUT_1, class_dir},  // (1) EV3 touch (device lego-ev3-touch, mode TOUCH)
+               {sysfs::INPUT_2, class_dir},  // (2) EV3 color (device lego-ev3-color, mode COL-REFLECT)
+               {sysfs::INPUT_4, class_dir}}, // (4) EV3 infrared (device lego-ev3-ir, mode IR-PROX)
+      _motors{{sysfs::OUTPUT_A, class_dir},  // (A) lego-ev3-l-motor (BEAM)
+              {sysfs::OUTPUT_B, class_dir},  // (B) lego-ev3-m-motor (TABLE)
+              {sysfs::OUTPUT_C, class_dir}}, // (C) lego-ev3-m-motor (SCANNER)
+      _start(chrono::steady_clock::now())
+{}
+
+bool Ev3Backend::connected(Motor motor) const { return _motors[motor].connected(); }
+
+bool Ev3Backend::connected(Sensor sensor) const { return _sensors[sensor].connected(); }
+
+int Ev3Backend::state(Motor motor) { return _motors[motor].state(); }
+
+int Ev3Backend::position(Motor motor) { return _motors[motor].position(); }
+
+int Ev3Backend::value(Sensor sensor, size_t index) { return _sensors[sensor].value(index); }
+
+Backend::Duration Ev3Backend::now() { return chrono::duration_cast<Duration>(chrono::steady_clock::now() - _start); }
+
+void Ev3Backend::reset(Motor motor) { _motors[motor].reset(); }
+
+void Ev3Backend::stop(Motor motor) { _motors[motor].stop(); }
+
+void Ev3Backend::run_forever(Motor motor) { _motors[motor].run_forever(); }
+
+void Ev3Backend::run_to_rel_pos(Motor motor) { _motors[motor].run_to_rel_pos(); }
+
+void Ev3Backend::set_stop_action(Motor motor, string const &action) { _motors[motor].set_stop_action(action); }
+
+void Ev3Backend::set_speed_sp(Motor motor, int speed) { _motors[motor].set_speed_sp(speed); }
+
+void Ev3Backend::set_position_sp(Motor motor, int position) { _motors[motor].set_position_sp(position); }
+
+void Ev3Backend::set_mode(Sensor sensor, string const &mode) { _sensors[sensor].set_mode(mode); }
+
+void Ev3Backend::sleep_for(Duration duration) { this_thread::sleep_for(duration); }
+
+void Ev3Backend::speak(string const &msg)
+{
+#ifdef CRAWLER_HOST
+    cout << "crawler says: " << msg << "\n";
+#else
+    ev3dev::sound::speak(msg, true);
+#endif
+}
+
+} // namespace detail
@@ -0,0 +1,362 @@
+#include "backend.hpp"
+#include "classifier.hpp"
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+constexpr Backend::Duration ACCESS_LATENCY(200);  // per attribute access, roughly sysfs on the brick
+constexpr Backend::Duration RAMP_TIME(120000);     // acceleration/deceleration overhead per motor command
+constexpr Backend::Duration SPEAK_TIME(1500000);   // espeak is synchronous on the brick
+constexpr double MAX_STEP_US = 1000.0;             // integration step of the mechanics
+
+// Physical beam angles (0 is the stalled home position)
+constexpr double BEAM_START = -120.0;
+constexpr double BEAM_ENGAGED = mechanics::BEAM_HOME + mechanics::BEAM_ENGAGE + 20.0;
+constexpr double BEAM_FLIPPED = mechanics::BEAM_HOME + mechanics::BEAM_ENGAGE + mechanics::BEAM_PULL - 10.0;
+constexpr double BEAM_CLEAR = mechanics::BEAM_HOME - 60.0;
+
+// Table angle (in motor degrees, ccw) rounded to whole quarter turns
+int quarters_of(double ccw) { return (int)floor((ccw + mechanics::TABLE_QUARTER / 2.0) / mechanics::TABLE_QUARTER); }
+
+// COL-COLOR codes: 0 none, 1 black, 2 blue, 3 green, 4 yellow, 5 red, 6 white, 7 brown (orange reads as brown)
+int color_code(Rubiks::Color color)
+{
+    switch (color)
+    {
+    case Rubiks::RED:
+        return 5;
+    case Rubiks::ORANGE:
+        return 7;
+    case Rubiks::GREEN:
+        return 3;
+    case Rubiks::BLUE:
+        return 2;
+    case Rubiks::YELLOW:
+        return 4;
+    case Rubiks::WHITE:
+    default:
+        return 6;
+    }
+}
+
+} // namespace
+
+namespace detail {
+
+SimBackend::SimBackend(Rubiks const &cube, unsigned seed)
+    : _clock(0), _cube(cube), _engaged(false), _quarters(0), _noise(seed)
+{
+    _motors[BEAM].offset = BEAM_START;
+    _modes[COLOR] = "COL-REFLECT";
+    _modes[CUBE] = "IR-PROX";
+    _modes[BUTTON] = "TOUCH";
+}
+
+bool SimBackend::connected(Motor /*motor*/) const { return true; }
+
+bool SimBackend::connected(Sensor /*sensor*/) const { return true; }
+
+int SimBackend::state(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+
+    auto const &m = _motors[motor];
+    int flags = 0;
+    if (m.mode != IDLE || _clock < m.ramp_until)
+        flags |= RUNNING;
+    if (_clock < m.ramp_until)
+        flags |= RAMPING;
+    if (m.mode == IDLE && m.stop_action == "hold")
+        flags |= HOLDING;
+    if (m.stalled)
+        flags |= STALLED;
+    return flags;
+}
+
+int SimBackend::position(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+    return (int)lround(_motors[motor].position);
+}
+
+int SimBackend::value(Sensor sensor, size_t index)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+
+    switch (sensor)
+    {
+    case BUTTON:
+        return 0;
+
+    case CUBE:
+        return 3; // IR-PROX: the cube sits right in front of the sensor
+
+    case COLOR:
+    default:
+        break;
+    }
+
+    int pos = sensed();
+    string const &mode = _modes[COLOR];
+    if (pos < 0)
+        return mode == "RGB-RAW" ? 5 : mode == "COL-COLOR" ? 0 : 1;
+
+    auto color = _cube.color((Rubiks::Face)(pos / 9 * 9), (Rubiks::Cell)(pos % 9));
+    if (mode == "COL-COLOR")
+        return color_code(color);
+
+    auto rgb = reference(color); // the sensor reads what it was calibrated on, give or take some noise
+    normal_distribution<double> noise(0.0, 8.0);
+    if (mode == "RGB-RAW")
+    {
+        double channel = index == 0 ? rgb.r : index == 1 ? rgb.g : rgb.b;
+        return max(0, (int)lround(channel + noise(_noise)));
+    }
+
+    return max(0, min(100, (int)lround((rgb.r + rgb.g + rgb.b) / 8.0 + noise(_noise) / 4.0))); // COL-REFLECT
+}
+
+Backend::Duration SimBackend::now()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _clock;
+}
+
+void SimBackend::reset(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(true);
+
+    auto &m = _motors[motor];
+    m.offset += m.position;
+    m.position = 0.0;
+    m.speed_sp = 0;
+    m.position_sp = 0;
+    m.stop_action = "coast";
+    m.mode = IDLE;
+    m.ramp_until = Duration(0);
+    m.stalled = false;
+
+    if (motor == TURNTABLE)
+        _quarters = quarters_of(-m.offset);
+}
+
+void SimBackend::stop(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(true);
+
+    auto &m = _motors[motor];
+    m.mode = IDLE;
+    m.stalled = false;
+}
+
+void SimBackend::run_forever(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(true);
+
+    auto &m = _motors[motor];
+    m.mode = FOREVER;
+    m.stalled = false;
+}
+
+void SimBackend::run_to_rel_pos(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(true);
+
+    auto &m = _motors[motor];
+    m.mode = RUN_TO;
+    m.target = m.position + m.position_sp;
+    m.stalled = false;
+}
+
+void SimBackend::set_stop_action(Motor motor, string const &action)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+    _motors[motor].stop_action = action;
+}
+
+void SimBackend::set_speed_sp(Motor motor, int speed)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+    _motors[motor].speed_sp = speed;
+}
+
+void SimBackend::set_position_sp(Motor motor, int position)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+    _motors[motor].position_sp = position;
+}
+
+void SimBackend::set_mode(Sensor sensor, string const &mode)
+{
+    lock_guard<mutex> lock(_mutex);
+    access(false);
+    _modes[sensor] = mode;
+}
+
+void SimBackend::sleep_for(Duration duration)
+{
+    lock_guard<mutex> lock(_mutex);
+    advance(duration);
+}
+
+void SimBackend::speak(string const &msg)
+{
+    lock_guard<mutex> lock(_mutex);
+    cout << "crawler says: " << msg << "\n";
+    advance(SPEAK_TIME);
+}
+
+Rubiks SimBackend::cube() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _cube;
+}
+
+SimBackend::Stats SimBackend::stats() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _stats;
+}
+
+void SimBackend::access(bool command)
+{
+    _stats.accesses++;
+    _stats.commands += command;
+    advance(ACCESS_LATENCY);
+}
+
+void SimBackend::advance(Duration duration)
+{
+    double remaining = (double)duration.count();
+    while (remaining > 0.0)
+    {
+        double dt = min(remaining, MAX_STEP_US);
+        step(dt);
+        remaining -= dt;
+        _clock += Duration((Duration::rep)dt);
+    }
+}
+
+void SimBackend::step(double dt_us)
+{
+    for (int i = BEAM; i <= SCANNER; i++)
+    {
+        auto &m = _motors[i];
+        if (m.mode == IDLE)
+            continue;
+
+        double distance = abs(m.speed_sp) * dt_us / 1e6;
+        double from = m.position;
+        double to = from;
+
+        if (m.mode == RUN_TO)
+        {
+            double todo = m.target - from;
+            to = abs(todo) <= distance ? m.target : from + (todo < 0 ? -distance : distance);
+        }
+        else // FOREVER
+        {
+            to = from + (m.speed_sp < 0 ? -distance : distance);
+        }
+
+        if (i == BEAM && to + m.offset > 0.0) // the beam stalls at its home position
+        {
+            to = -m.offset;
+            m.stalled = true;
+        }
+
+        if (i == TURNTABLE && to != from)
+        {
+            double beam = _motors[BEAM].position + _motors[BEAM].offset;
+            if (beam > BEAM_ENGAGED && beam < BEAM_CLEAR) // beam hangs over the cube, blocking it
+            {
+                if (!m.stalled)
+                    _stats.faults++;
+                m.stalled = true;
+                m.mode = IDLE;
+                continue;
+            }
+        }
+
+        m.position = to;
+
+        if (i == BEAM)
+            move_beam(from + m.offset, to + m.offset);
+        else if (i == TURNTABLE)
+            move_table(from + m.offset, to + m.offset);
+
+        if (m.mode == RUN_TO && to == m.target)
+        {
+            m.mode = IDLE;
+            m.ramp_until = _clock + RAMP_TIME;
+        }
+    }
+}
+
+void SimBackend::move_beam(double /*from*/, double to)
+{
+    if (to <= BEAM_ENGAGED)
+    {
+        _engaged = true;
+    }
+    else if (_engaged && to >= BEAM_FLIPPED) // pulled back from holding, tips the cube over
+    {
+        _engaged = false;
+        _cube.rotate(Rubiks::BACK, 1);
+        _stats.flips++;
+    }
+}
+
+void SimBackend::move_table(double /*from*/, double to)
+{
+    int quarters = quarters_of(-to); // negative is ccw
+    int n = quarters - _quarters;
+    if (n == 0)
+        return;
+
+    if (_engaged)
+        _cube.turn(Rubiks::DOWN, n); // only the bottom layer turns with the table
+    else
+        _cube.rotate(Rubiks::DOWN, n);
+
+    _quarters = quarters;
+    _stats.quarter_turns += abs(n);
+}
+
+int SimBackend::sensed() const
+{
+    double scanner = _motors[SCANNER].position + _motors[SCANNER].offset;
+    auto const &table = _motors[TURNTABLE];
+    double ccw = -(table.position + table.offset);
+    double offset = ccw - quarters_of(ccw) * mechanics::TABLE_QUARTER; // -135 .. 135
+
+    if (abs(scanner - mechanics::SCANNER_CENTER) < 30.0)
+        return Rubiks::UP + Rubiks::CC;
+
+    if (scanner < mechanics::SCANNER_EDGE - 20.0 || scanner > mechanics::SCANNER_CORNER + 20.0)
+        return -1; // not above the ring of side centers and corners
+
+    // The sensor looks at the cells at the device's right side
+    if (abs(offset) < 45.0)
+        return Rubiks::UP + Rubiks::E;
+    if (offset >= 90.0) // 45 degrees ccw past a quarter
+        return Rubiks::UP + Rubiks::SE;
+    if (offset <= -90.0) // 45 degrees cw short of a quarter
+        return Rubiks::UP + Rubiks::NE;
+    return -1;
+}
+
+} // namespace detail
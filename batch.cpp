@@ -0,0 +1,364 @@
+#include "batch.hpp"
+#include "cache.hpp"
+#include "orient.hpp"
+#include "states.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+constexpr char MAGIC[] = "CCBS";
+constexpr char VERSION = 1;
+constexpr size_t STATE_SIZE = 54;
+constexpr size_t CHUNK = 256; // states
+constexpr size_t CHUNKS_PER_WORKER = 4; // in flight
+
+// Counts of values: exact up to EXACT, within 1/64 above, in constant memory whatever the number of values
+class Histogram
+{
+  public:
+    Histogram() : _counts(EXACT + (64 - 10) * 64, 0), _total(0), _sum(0), _max(0) {}
+
+    void add(uint64_t value)
+    {
+        _counts[index_of(value)]++;
+        _total++;
+        _sum += value;
+        _max = max(_max, value);
+    }
+
+    void add(Histogram const &other)
+    {
+        for (size_t i = 0; i < _counts.size(); i++)
+            _counts[i] += other._counts[i];
+        _total += other._total;
+        _sum += other._sum;
+        _max = max(_max, other._max);
+    }
+
+    auto spread() const -> batch::Spread
+    {
+        batch::Spread spread = {};
+        if (_total == 0)
+            return spread;
+
+        spread.mean = (double)_sum / _total;
+        spread.p50 = percentile(0.50);
+        spread.p90 = percentile(0.90);
+        spread.p99 = percentile(0.99);
+        spread.max = (double)_max;
+        return spread;
+    }
+
+  private:
+    static constexpr uint64_t EXACT = 1024;
+
+    static size_t index_of(uint64_t value)
+    {
+        if (value < EXACT)
+            return (size_t)value;
+        int e = 63;
+        while ((value >> e) == 0)
+            e--;
+        return (size_t)(EXACT + (e - 10) * 64 + ((value >> (e - 6)) & 63));
+    }
+
+    static uint64_t value_of(size_t index)
+    {
+        if (index < EXACT)
+            return index;
+        auto e = (index - EXACT) / 64 + 10;
+        auto m = (index - EXACT) % 64;
+        return (64 + m) << (e - 6);
+    }
+
+    double percentile(double p) const
+    {
+        auto rank = (uint64_t)(p * (_total - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); i++)
+        {
+            seen += _counts[i];
+            if (seen > rank)
+                return (double)min(value_of(i), _max);
+        }
+        return (double)_max;
+    }
+
+    vector<uint64_t> _counts;
+    uint64_t _total;
+    uint64_t _sum;
+    uint64_t _max;
+};
+
+constexpr uint64_t Histogram::EXACT;
+
+// Outcome of the states of a chunk, as they go into the output
+struct Chunk {
+    vector<string> states;
+    string output;
+    uint64_t solved, rejected, failed;
+    atomic<bool> done;
+};
+
+// Queues of chunks per worker; a worker takes the oldest of its own, or else steals the oldest of another's (the
+// writer waits on the oldest chunk, so that goes first)
+class Scheduler
+{
+  public:
+    explicit Scheduler(size_t workers) : _queues(workers), _next(0), _queued(0), _closed(false) {}
+
+    // Deals out chunks round-robin
+    void deal(size_t chunk)
+    {
+        auto &queue = _queues[_next++ % _queues.size()];
+        {
+            lock_guard<std::mutex> lock(queue.mutex);
+            queue.chunks.push_back(chunk);
+        }
+        {
+            lock_guard<mutex> lock(_mutex);
+            _queued++;
+        }
+        _work.notify_one();
+    }
+
+    // Takes a chunk for the worker, waiting for one; returns false once closed and all chunks are taken
+    bool take(size_t worker, size_t &chunk)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _work.wait(lock, [this] { return _queued > 0 || _closed; });
+            if (_queued == 0)
+                return false;
+            _queued--; // a chunk is ours now, in some queue
+        }
+
+        for (size_t i = 0;; i++)
+        {
+            auto &queue = _queues[(worker + i) % _queues.size()];
+            lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.chunks.empty())
+            {
+                chunk = queue.chunks.front();
+                queue.chunks.pop_front();
+                return true;
+            }
+        }
+    }
+
+    void close()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _closed = true;
+        }
+        _work.notify_all();
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        deque<size_t> chunks;
+    };
+
+    vector<Queue> _queues;
+    size_t _next; // to deal to
+    mutex _mutex; // guards the counters
+    condition_variable _work;
+    size_t _queued;
+    bool _closed;
+};
+
+void write_varint(string &out, uint64_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        out.push_back((char)(value | 0x80));
+    out.push_back((char)value);
+}
+
+// Reads up to CHUNK states; returns false at the end of the input
+bool read_chunk(istream &in, Chunk &chunk)
+{
+    chunk.states.clear();
+    string line;
+    while (chunk.states.size() < CHUNK && getline(in, line))
+    {
+        auto end = line.find_last_not_of(" \t\r");
+        if (end == string::npos)
+            continue;
+        auto begin = line.find_last_of(" \t", end) + 1; // (0 without an id)
+        chunk.states.push_back(line.substr(begin, end + 1 - begin));
+    }
+    return !chunk.states.empty();
+}
+
+// Checks the state up front, as most of a corpus of bad states would cost an exception each otherwise
+bool parse(string const &state, Rubiks &cube)
+{
+    StateFile::Packed packed;
+    if (StateFile::check(state.data(), state.size(), packed) != StateFile::OK)
+        return false;
+    cube = Rubiks(state);
+    return true;
+}
+
+} // namespace
+
+namespace batch {
+
+Solver::Strategy parse_strategy(string const &name)
+{
+    if (name == "l123" || name == "L123")
+        return Solver::L123;
+    if (name == "cfop" || name == "CFOP")
+        return Solver::CFOP;
+    if (name == "twophase")
+        return Solver::TWO_PHASE;
+    if (name == "portfolio")
+        return Solver::PORTFOLIO;
+    throw invalid_argument("batch: unknown strategy: " + name);
+}
+
+Summary run(Options const &options, function<bool()> const &interrupted)
+{
+    ifstream in(options.in);
+    if (!in)
+        throw runtime_error("batch: cannot read " + options.in);
+    ofstream out(options.out, ios::binary);
+    if (!out)
+        throw runtime_error("batch: cannot write " + options.out);
+    out << string(MAGIC, sizeof(MAGIC) - 1) << VERSION;
+
+    shared_ptr<SolutionCache> cache;
+    if (!options.cache.empty())
+        cache = make_shared<SolutionCache>(options.cache);
+
+    auto workers = max(options.threads, (size_t)1);
+    vector<Chunk> slots(workers * CHUNKS_PER_WORKER);
+    Scheduler scheduler(workers);
+    mutex done_mutex;
+    condition_variable chunk_done;
+    vector<Histogram> latencies(workers), moves(workers);
+
+    auto start = Clock::now();
+    vector<thread> threads;
+    for (size_t worker = 0; worker < workers; worker++)
+    {
+        threads.emplace_back([&, worker] {
+            auto solver = Solver::Create(options.strategy);
+            if (options.orientations > 1) // on this worker's thread: the others are busy with states of their own
+                solver = make_shared<detail::OrientingSolver>(solver, options.orientations,
+                                                              detail::OrientingSolver::MOVES, 1);
+            if (cache != nullptr)
+                solver = make_shared<detail::CachingSolver>(solver, cache);
+            size_t slot;
+            while (scheduler.take(worker, slot))
+            {
+                auto &chunk = slots[slot];
+                chunk.output.clear();
+                chunk.solved = chunk.rejected = chunk.failed = 0;
+                for (auto const &state : chunk.states)
+                {
+                    Rubiks cube;
+                    if (!parse(state, cube))
+                    {
+                        chunk.rejected++;
+                        write_varint(chunk.output, 0);
+                        continue;
+                    }
+
+                    vector<Solver::Step> steps;
+                    try
+                    {
+                        auto before = Clock::now();
+                        steps = solver->solve(cube);
+                        latencies[worker].add(
+                            chrono::duration_cast<chrono::microseconds>(Clock::now() - before).count());
+                    }
+                    catch (exception const &)
+                    {
+                        chunk.failed++;
+                        write_varint(chunk.output, 0);
+                        continue;
+                    }
+
+                    chunk.solved++;
+                    moves[worker].add(count_if(steps.begin(), steps.end(), [](Solver::Step const &step) {
+                        return get<0>(step) == Solver::Turn;
+                    }));
+                    write_varint(chunk.output, steps.size() + 1);
+                    chunk.output += trace::pack(steps);
+                }
+
+                {
+                    lock_guard<mutex> lock(done_mutex);
+                    chunk.done = true;
+                }
+                chunk_done.notify_one();
+            }
+        });
+    }
+
+    // Keeps the slots filled from the input, and writes them out in order as they are done
+    Summary summary = {};
+    size_t read = 0, written = 0;
+    bool more = true;
+    while (written < read || (more && !interrupted()))
+    {
+        if (more && !interrupted() && read - written < slots.size())
+        {
+            auto &chunk = slots[read % slots.size()];
+            chunk.done = false;
+            more = read_chunk(in, chunk);
+            if (more)
+                scheduler.deal(read++ % slots.size());
+            continue;
+        }
+
+        auto &chunk = slots[written % slots.size()];
+        {
+            unique_lock<mutex> lock(done_mutex);
+            chunk_done.wait(lock, [&chunk] { return (bool)chunk.done; });
+        }
+        out.write(chunk.output.data(), chunk.output.size());
+        summary.states += chunk.states.size();
+        summary.solved += chunk.solved;
+        summary.rejected += chunk.rejected;
+        summary.failed += chunk.failed;
+        written++;
+    }
+
+    scheduler.close();
+    for (auto &thread : threads)
+        thread.join();
+    out.flush();
+    if (!out)
+        throw runtime_error("batch: failed writing " + options.out);
+
+    summary.seconds = chrono::duration<double>(Clock::now() - start).count();
+    summary.cached = cache != nullptr ? cache->stats().hits : 0;
+    for (size_t worker = 1; worker < workers; worker++)
+    {
+        latencies[0].add(latencies[worker]);
+        moves[0].add(moves[worker]);
+    }
+    summary.latency = latencies[0].spread();
+    summary.moves = moves[0].spread();
+    return summary;
+}
+
+} // namespace batch
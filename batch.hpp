@@ -0,0 +1,49 @@
+#pragma once
+
+#include "solver.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Solving a file of cube states, to regression-test the solvers over large corpora
+//
+// The states are read a chunk at a time and solved on a number of workers, each with a queue of chunks of its own
+// that other workers steal from when theirs runs dry. The solutions are written in the order of the input as soon as
+// they are in, so only the chunks in flight are held in memory, whatever the size of the file.
+//
+// Input: a line per cube, [ID ]STATE, with STATE the 54 color characters of a cube (lrbfdu); blank lines are skipped.
+// Output: "CCBS", version byte, then per state in input order
+//    steps + 1 (varint), steps (packed as in traces, a byte each)
+// with a 0 instead for states that were rejected, or that the solver failed on.
+//
+namespace batch {
+
+struct Options {
+    std::string in;
+    std::string out;
+    std::size_t threads;
+    Solver::Strategy strategy = Solver::L123;
+    std::string cache; // file of a solution cache to solve through, if any, see SolutionCache
+    std::size_t orientations = 1; // to solve each state in, keeping the fewest turns, see detail::OrientingSolver
+};
+
+// Spread of a measure over the states solved
+struct Spread {
+    double mean, p50, p90, p99, max;
+};
+
+struct Summary {
+    std::uint64_t states, solved, rejected, failed;
+    std::uint64_t cached; // of the solved, from the cache
+    double seconds; // wall time of the run
+    Spread latency; // µs to solve a state
+    Spread moves;   // turns in a solution
+};
+
+auto parse_strategy(std::string const &name) -> Solver::Strategy;
+
+// Solves the states in the input file into the output file, until done or interrupted
+auto run(Options const &options, std::function<bool()> const &interrupted) -> Summary;
+
+} // namespace batch
@@ -0,0 +1,310 @@
+#include "cache.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr char MAGIC[] = "CCSC";
+constexpr char VERSION = 2; // 1 keyed solutions by the strategy only
+constexpr size_t CONFIG_SIZE = 4;
+constexpr size_t KEY_SIZE = 16;
+constexpr int FACES = 6;
+
+[[noreturn]] void fail(string const &what) { throw runtime_error("cache: " + what + ": " + strerror(errno)); }
+
+vector<Solver::Step> renamed(vector<Solver::Step> const &steps, array<Rubiks::Face, FACES> const &to)
+{
+    vector<Solver::Step> result;
+    result.reserve(steps.size());
+    for (auto const &step : steps)
+        result.emplace_back(get<0>(step), to[get<1>(step) / 9], get<2>(step));
+    return result;
+}
+
+void put_key(string &bytes, Cubies::Key const &key)
+{
+    for (auto word : {key.low, key.high})
+        for (int i = 0; i < 8; i++)
+            bytes.push_back((char)(word >> (8 * i)));
+}
+
+Cubies::Key get_key(char const *bytes)
+{
+    Cubies::Key key = {0, 0};
+    for (int i = 0; i < 8; i++)
+    {
+        key.low |= (uint64_t)(uint8_t)bytes[i] << (8 * i);
+        key.high |= (uint64_t)(uint8_t)bytes[8 + i] << (8 * i);
+    }
+    return key;
+}
+
+void write_all(int fd, string const &bytes, string const &path)
+{
+    for (size_t written = 0; written < bytes.size();)
+    {
+        auto n = write(fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0 && errno != EINTR)
+            fail("cannot write " + path);
+        written += n < 0 ? 0 : n;
+    }
+}
+
+} // namespace
+
+constexpr size_t SolutionCache::DEFAULT_CAPACITY;
+
+SolutionCache::SolutionCache(string const &path, size_t capacity)
+    : _path(path), _capacity(max(capacity, (size_t)1)), _fd(-1), _records(0)
+{
+    load();
+}
+
+SolutionCache::~SolutionCache() { close(_fd); }
+
+SolutionCache::Canonical SolutionCache::canonical(Rubiks const &cube)
+{
+    Canonical canonical = {};
+    bool first = true;
+    for (auto const &orientation : orientations())
+    {
+        auto turned = cube;
+        apply(orientation.rotations, turned);
+        auto key = Cubies(turned).key();
+        if (first || key < canonical.key)
+        {
+            canonical.key = key;
+            canonical.to = orientation.to;
+            first = false;
+        }
+    }
+    return canonical;
+}
+
+vector<Solver::Step> SolutionCache::to_canonical(vector<Solver::Step> const &steps, Canonical const &canonical)
+{
+    return renamed(steps, canonical.to);
+}
+
+vector<Solver::Step> SolutionCache::from_canonical(vector<Solver::Step> const &steps, Canonical const &canonical)
+{
+    array<Rubiks::Face, FACES> from;
+    for (int face = 0; face < FACES; face++)
+        from[canonical.to[face] / 9] = (Rubiks::Face)(face * 9);
+    return renamed(steps, from);
+}
+
+SolutionCache::Stats SolutionCache::stats() const
+{
+    lock_guard<mutex> lock(_mutex);
+    auto stats = _stats;
+    stats.entries = _entries.size();
+    return stats;
+}
+
+bool SolutionCache::find(uint32_t config, Cubies::Key const &key, vector<Solver::Step> &steps)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto found = _index.find({key, config});
+    if (found == _index.end())
+    {
+        _stats.misses++;
+        return false;
+    }
+
+    _entries.splice(_entries.begin(), _entries, found->second);
+    _stats.hits++;
+    steps = trace::unpack(found->second->steps);
+    return true;
+}
+
+void SolutionCache::insert(uint32_t config, Cubies::Key const &key, vector<Solver::Step> const &steps)
+{
+    lock_guard<mutex> lock(_mutex);
+    Entry entry = {config, key, trace::pack(steps)};
+    append(entry);
+    add(move(entry));
+    if (_records > 2 * _capacity)
+        compact();
+}
+
+void SolutionCache::load()
+{
+    _fd = open(_path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0)
+        fail("cannot open " + _path);
+    struct stat st;
+    if (fstat(_fd, &st) < 0)
+        fail("cannot read " + _path);
+
+    size_t size = st.st_size;
+    if (size == 0)
+    {
+        write_all(_fd, string(MAGIC, sizeof(MAGIC) - 1) + VERSION, _path);
+        return;
+    }
+
+    auto mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (mapped == MAP_FAILED)
+        fail("cannot map " + _path);
+    auto data = (char const *)mapped;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    if (size < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC) - 1) != 0 || data[sizeof(MAGIC) - 1] != VERSION)
+    {
+        munmap(mapped, size);
+        throw runtime_error("cache: not a solution cache, or another version: " + _path);
+    }
+
+    size_t pos = sizeof(MAGIC), end = pos;
+    while (pos + CONFIG_SIZE + KEY_SIZE < size)
+    {
+        Entry entry;
+        entry.config = 0;
+        for (size_t i = 0; i < CONFIG_SIZE; i++)
+            entry.config |= (uint32_t)(uint8_t)data[pos + i] << (8 * i);
+        entry.key = get_key(data + pos + CONFIG_SIZE);
+
+        size_t at = pos + CONFIG_SIZE + KEY_SIZE, length = 0;
+        bool complete = false;
+        for (int shift = 0; at < size && shift <= 28; shift += 7)
+        {
+            auto byte = (uint8_t)data[at++];
+            length |= (size_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || at + length > size)
+            break;
+
+        entry.steps.assign(data + at, length);
+        add(move(entry));
+        _records++;
+        pos = end = at + length;
+    }
+    munmap(mapped, size);
+
+    // Appending after a record cut short would garble the ones after
+    if (end < size && ftruncate(_fd, end) < 0)
+        fail("cannot truncate " + _path);
+}
+
+void SolutionCache::add(Entry entry)
+{
+    auto found = _index.find({entry.key, entry.config});
+    if (found != _index.end())
+        _entries.erase(found->second);
+
+    Slot slot = {entry.key, entry.config};
+    _entries.push_front(move(entry));
+    _index[slot] = _entries.begin();
+
+    while (_entries.size() > _capacity)
+    {
+        _index.erase({_entries.back().key, _entries.back().config});
+        _entries.pop_back();
+        _stats.evictions++;
+    }
+}
+
+void SolutionCache::append(Entry const &entry)
+{
+    string record;
+    for (size_t i = 0; i < CONFIG_SIZE; i++)
+        record.push_back((char)(entry.config >> (8 * i)));
+    put_key(record, entry.key);
+    auto length = entry.steps.size();
+    for (; length >= 0x80; length >>= 7)
+        record.push_back((char)((length & 0x7f) | 0x80));
+    record.push_back((char)length);
+    record += entry.steps;
+
+    write_all(_fd, record, _path);
+    _records++;
+}
+
+void SolutionCache::compact()
+{
+    // Into a file of its own first, so that a crash halfway leaves the old one
+    auto tmp = _path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0)
+        fail("cannot open " + tmp);
+    swap(fd, _fd);
+    try
+    {
+        _records = 0;
+        write_all(_fd, string(MAGIC, sizeof(MAGIC) - 1) + VERSION, tmp);
+        for (auto it = _entries.rbegin(); it != _entries.rend(); ++it)
+            append(*it);
+    }
+    catch (...)
+    {
+        close(_fd);
+        _fd = fd;
+        throw;
+    }
+    close(fd);
+    if (rename(tmp.c_str(), _path.c_str()) < 0)
+        fail("cannot replace " + _path);
+}
+
+namespace detail {
+
+CachingSolver::CachingSolver(shared_ptr<Solver> solver, shared_ptr<SolutionCache> cache)
+    : _solver(solver), _cache(cache)
+{
+}
+
+void CachingSolver::set_log(ostream &os)
+{
+    BaseSolver::set_log(os);
+    _solver->set_log(os);
+}
+
+void CachingSolver::set_placement(Placement const &placement)
+{
+    BaseSolver::set_placement(placement);
+    _solver->set_placement(placement);
+}
+
+void CachingSolver::set_cancel(atomic<bool> const *cancel)
+{
+    BaseSolver::set_cancel(cancel);
+    _solver->set_cancel(cancel);
+}
+
+void CachingSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
+{
+    auto canonical = SolutionCache::canonical(cube);
+    vector<Step> steps;
+    if (_cache->find(config_id(), canonical.key, steps))
+    {
+        steps = SolutionCache::from_canonical(steps, canonical);
+        apply(steps, cube);
+        log() << "solved from the cache in " << steps.size() << " steps\n";
+        emit(steps);
+        return;
+    }
+
+    _solver->solve(cube, [&steps, &emit](vector<Step> const &stage) {
+        steps.insert(steps.end(), stage.begin(), stage.end());
+        emit(stage);
+    });
+    _cache->insert(config_id(), canonical.key, SolutionCache::to_canonical(steps, canonical));
+}
+
+} // namespace detail
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "cubie.hpp"
+#include "solver.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Solutions found before, by state, kept in a file
+//
+// States are cached up to symmetry: a cube turned around as a whole, or with other colors, is the same state with the
+// same solution, only with the faces (or colors) named otherwise. So a state is keyed by its canonical form, the least
+// of the cubie states of its 24 orientations, and its solution is kept for that orientation (see 'canonical'). Each
+// solver setup (Solver::config_id) has solutions of its own: L123 tried in 24 orientations finds shorter ones than
+// plain L123 does.
+//
+// The file is append-only: "CCSC", a version byte, and records of
+//    config id (4 bytes), key (16 bytes), number of steps (varint), steps (a byte each, as in traces)
+// all little-endian.
+// It is memory-mapped and read at once when opened; later records of a state win. The least recently used states
+// are evicted beyond the capacity, and once the file holds twice that many records, it is rewritten with the live
+// ones only. A record cut short (by a crash halfway a write) ends the file.
+//
+class SolutionCache
+{
+  public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 65536; // states
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+    };
+
+    // A state in canonical form, and how to get there: the face of the canonical orientation that each face is at
+    struct Canonical {
+        Cubies::Key key;
+        std::array<Rubiks::Face, 6> to; // by face / 9
+    };
+
+    // Opens (or creates) the cache file, keeping the given number of states at most
+    explicit SolutionCache(std::string const &path, std::size_t capacity = DEFAULT_CAPACITY);
+    ~SolutionCache();
+
+    SolutionCache(SolutionCache const &) = delete;
+    SolutionCache &operator=(SolutionCache const &) = delete;
+
+    // The canonical form of the cube, which must be valid
+    static auto canonical(Rubiks const &cube) -> Canonical;
+
+    // The steps with their faces renamed as from the cube to its canonical orientation, or back
+    static auto to_canonical(std::vector<Solver::Step> const &steps, Canonical const &canonical)
+        -> std::vector<Solver::Step>;
+    static auto from_canonical(std::vector<Solver::Step> const &steps, Canonical const &canonical)
+        -> std::vector<Solver::Step>;
+
+    /*
+        Queries:
+    */
+
+    auto stats() const -> Stats;
+
+    /*
+        Commands:
+    */
+
+    // The solution of the state by the solver setup, in canonical orientation, if cached (counted as a hit or a miss)
+    bool find(std::uint32_t config, Cubies::Key const &key, std::vector<Solver::Step> &steps);
+
+    // Caches the solution of the state by the solver setup, in canonical orientation
+    void insert(std::uint32_t config, Cubies::Key const &key, std::vector<Solver::Step> const &steps);
+
+  private:
+    struct Entry {
+        std::uint32_t config;
+        Cubies::Key key;
+        std::string steps; // packed
+    };
+    using Entries = std::list<Entry>; // most recently used first
+
+    struct Slot {
+        Cubies::Key key;
+        std::uint32_t config;
+        bool operator==(Slot const &other) const { return key == other.key && config == other.config; }
+    };
+    struct SlotHash {
+        auto operator()(Slot const &slot) const -> std::size_t
+        {
+            return Cubies::Key::Hash()(slot.key) ^ (std::size_t)slot.config * 0x9e3779b97f4a7c15u;
+        }
+    };
+
+    void load();
+    void add(Entry entry); // to the front, evicting beyond capacity
+    void append(Entry const &entry);
+    void compact();
+
+    std::string _path;
+    std::size_t _capacity;
+    int _fd; // appending
+    std::size_t _records; // in the file
+    mutable std::mutex _mutex;
+    Entries _entries;
+    std::unordered_map<Slot, Entries::iterator, SlotHash> _index;
+    Stats _stats;
+};
+
+namespace detail {
+
+// Solves through a cache: a state seen before, in any orientation and colors, gets the solution found then
+class CachingSolver final : public BaseSolver
+{
+  public:
+    CachingSolver(std::shared_ptr<Solver> solver, std::shared_ptr<SolutionCache> cache);
+    virtual ~CachingSolver() = default;
+
+    auto strategy() const -> Strategy override { return _solver->strategy(); };
+    auto config_id() const -> std::uint32_t override { return _solver->config_id(); }
+
+    // Also passed on to the solver
+    void set_log(std::ostream &os) override;
+    void set_placement(Placement const &placement) override;
+    void set_cancel(std::atomic<bool> const *cancel) override;
+
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
+
+  private:
+    std::shared_ptr<Solver> _solver;
+    std::shared_ptr<SolutionCache> _cache;
+};
+
+} // namespace detail
@@ -0,0 +1,648 @@
+#include "cfop.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+constexpr int MOVES = 18; // a move is face * 3 + (quarter turn, half turn, quarter turn back)
+constexpr int TURNS[] = {1, 2, -1};
+constexpr uint8_t NONE = 0xff;
+constexpr uint16_t UNREACHED = 0xffff;
+
+// Slots, as in Rubiks::corner_slots and Rubiks::edge_slots
+constexpr uint8_t CROSS_EDGES[] = {3, 7, 9, 11}; // of DOWN
+constexpr uint8_t TOP_CORNERS[] = {4, 5, 6, 7};
+constexpr uint8_t TOP_EDGES[] = {0, 4, 8, 10};
+constexpr uint8_t PAIRS[][2] = {{0, 2}, {1, 5}, {2, 1}, {3, 6}}; // corner and edge: FL, FR, BL, BR
+constexpr int CROSS_STATES = 24 * 24 * 24 * 24;                     // a slot and a flip per edge
+constexpr int PAIR_STATES = 24 * 24;                                 // a slot and a twist, a slot and a flip
+constexpr int OLL_STATES = 81 * 16;                                  // twists and flips of the last layer
+constexpr int PLL_STATES = 24 * 24;                                  // permutations of its corners and edges
+constexpr int LL_STATES = PLL_STATES * OLL_STATES;                   // the last layer as a whole
+
+// The OLL algorithms, one per case, in face turns only: wide and slice turns are rewritten as face turns, with the
+// rotation they imply folded into the faces after them
+char const *const OLL[] = {
+    "R U2 R2 F R F' U2 R' F R F'",        // 1
+    "F R U R' U' F' B U L U' L' B'",      // 2
+    "B U L U' L' B' U' F R U R' U' F'",   // 3
+    "B U L U' L' B' U F R U R' U' F'",    // 4
+    "L' B2 R B R' B L",                   // 5
+    "L F2 R' F' R F' L'",                 // 6
+    "L F R' F R F2 L'",                   // 7
+    "R' F' L F' L' F2 R",                 // 8
+    "R U R' U' R' F R2 U R' U' F'",       // 9
+    "R U R' U R' F R F' R U2 R'",         // 10
+    "L F R' F R' D R D' R F2 L'",         // 11
+    "R2 L F' R F' R' F2 R F' R L'",       // 12
+    "F U R U2 R' U' R U R' F'",           // 13
+    "R' F R U R' F' R F U' F'",           // 14
+    "L' B' L R' U' R U L' B L",           // 15
+    "L F L' R U R' U' L F' L'",           // 16
+    "R U R' U R' F R F' U2 R' F R F'",    // 17
+    "L F R' F R F2 L2 B' R B' R' B2 L",   // 18
+    "L' R B R B R' B' R2 L F R F'",       // 19
+    "L F R' F' R2 L2 B R B' R' B' R' L",  // 20
+    "R U2 R' U' R U R' U' R U' R'",       // 21
+    "R U2 R2 U' R2 U' R2 U2 R",           // 22
+    "R2 D R' U2 R D' R' U2 R'",           // 23
+    "L F R' F' L' F R F'",                // 24
+    "F' L F R' F' L' F R",                // 25
+    "R U2 R' U' R U' R'",                 // 26
+    "R U R' U R U2 R'",                   // 27
+    "L F R' F' R L' U R U' R'",           // 28
+    "R U R' U' R U' R' F' U' F R U R'",   // 29
+    "F R' F R2 U' R' U' R U R' F2",       // 30
+    "R' U' F U R U' R' F' R",             // 31
+    "L U F' U' L' U L F L'",              // 32
+    "R U R' U' R' F R F'",                // 33
+    "R U R2 U' R' F R U R U' F'",         // 34
+    "R U2 R2 F R F' R U2 R'",             // 35
+    "L' U' L U' L' U L U L F' L' F",      // 36
+    "F R' F' R U R U' R'",                // 37
+    "R U R' U R U' R' U' R' F R F'",      // 38
+    "L F' L' U' L U F U' L'",             // 39
+    "R' F R U R' U' F' U R",              // 40
+    "R U R' U R U2 R' F R U R' U' F'",    // 41
+    "R' U' R U' R' U2 R F R U R' U' F'",  // 42
+    "F' U' L' U L F",                     // 43
+    "F U R U' R' F'",                     // 44
+    "F R U R' U' F'",                     // 45
+    "R' U' R' F R F' U R",                // 46
+    "F' L' U' L U L' U' L U F",           // 47
+    "F R U R' U' R U R' U' F'",           // 48
+    "L F' L2 B L2 F L2 B' L",             // 49
+    "L' B L2 F' L2 B' L2 F L'",           // 50
+    "F U R U' R' U R U' R' F'",           // 51
+    "R U R' U R U' B U' B' R'",           // 52
+    "R' F2 L F L' F' L F L' F R",         // 53
+    "L F2 R' F' R F R' F' R F' L'",       // 54
+    "R U2 R2 U' R U' R' U2 F R F'",       // 55
+    "L F L' U R U' R' U R U' R' L F' L'", // 56
+    "R U R' U' R' L F R F' L'",           // 57
+};
+
+// The PLL algorithms, one per case, written the same way
+char const *const PLL[] = {
+    "R U' R U R U R U' R' U' R2",                            // Ua
+    "R2 U R U R' U' R' U' R' U R'",                          // Ub
+    "R2 U2 R U2 R2 U2 R2 U2 R U2 R2",                        // H
+    "R' U' R U' R U R U' R' U R U R2 U' R'",                 // Z
+    "R' F R' B2 R F' R' B2 R2",                              // Aa
+    "R2 B2 R F R' B2 R F' R",                                // Ab
+    "R U R' U' R' F R2 U' R' U' R U R' F'",                  // T
+    "L' U' L F L' U' L U L F' L2 U L",                       // Ja
+    "R U R' F' R U R' U' R' F R2 U' R'",                     // Jb
+    "R U' R' U' R U R D R' U' R D' R' U2 R'",                // Ra
+    "R2 F R U R U' R' F' R U2 R' U2 R",                      // Rb
+    "R' U' F' R U R' U' R' F R2 U' R' U' R U R' U R",        // F
+    "L' B L F' L' B' L F L' B' L F' L' B L F",               // E
+    "R' U R' U' B' R' B2 U' B' U B' R B R",                  // V
+    "R2 U R' U R' U' R U' R2 U' D R' U R D'",                // Ga
+    "R' U' R U D' R2 U R' U R U' R U' R2 D",                 // Gb
+    "R2 U' R U' R U R' U R2 U D' R U' R' D",                 // Gc
+    "R U R' U' D R2 U' R U' R' U R' U R2 D'",                // Gd
+    "R U R' U R U R' F' R U R' U' R' F R2 U' R' U2 R U' R'", // Na
+    "R' U R U' R' F' U' F R U R' F R' F' R U' R",            // Nb
+    "F R U' R' U' R U R' F' R U R' U' R' F R F'",            // Y
+};
+
+struct Algorithm {
+    vector<Solver::Step> steps;
+    Cubies effect, inverse; // what it does to a solved cube, and what undoes it
+};
+
+// The cheapest generators from each state (as indexed) to solved, first generator and total turns
+struct Table {
+    vector<uint16_t> cost;
+    vector<uint8_t> next;
+};
+
+// A case of the last layer, compiled: the turns that solve it, and what they do
+struct Case {
+    bool known = false;
+    vector<Solver::Step> steps;
+    Cubies effect;
+};
+
+// The table for an F2L pair, with the U turns and triggers it may use
+struct F2l {
+    vector<Algorithm> macros;
+    Table table;
+};
+
+struct Tables {
+    vector<uint8_t> cross;                 // turns to solved, by cross state
+    array<array<int, 24>, MOVES> edge_to;  // by move and edge slot * 2 + flip, where a turn takes an edge
+    array<array<F2l, 16>, 4> f2l;          // by pair and set of pairs to solve (including it)
+    vector<Case> oll, pll;                 // by state, none for unreachable states
+};
+
+Algorithm algorithm(vector<Solver::Step> const &steps)
+{
+    Algorithm result;
+    result.steps = steps;
+    for (auto const &step : steps)
+        result.effect = result.effect * Cubies::turn(get<1>(step), get<2>(step));
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        result.inverse.cp[result.effect.cp[i]] = i;
+        result.inverse.co[result.effect.cp[i]] = (uint8_t)((3 - result.effect.co[i]) % 3);
+    }
+    for (uint8_t i = 0; i < 12; i++)
+    {
+        result.inverse.ep[result.effect.ep[i]] = i;
+        result.inverse.eo[result.effect.ep[i]] = (uint8_t)((2 - result.effect.eo[i]) % 2);
+    }
+    return result;
+}
+
+bool keeps_corner(Cubies const &state, int slot) { return state.cp[slot] == slot && state.co[slot] == 0; }
+bool keeps_edge(Cubies const &state, int slot) { return state.ep[slot] == slot && state.eo[slot] == 0; }
+
+// Whether the state has the first two layers as solved
+bool keeps_f2l(Cubies const &state)
+{
+    bool keeps = true;
+    for (auto edge : CROSS_EDGES)
+        keeps = keeps && keeps_edge(state, edge);
+    for (auto const &pair : PAIRS)
+        keeps = keeps && keeps_corner(state, pair[0]) && keeps_edge(state, pair[1]);
+    return keeps;
+}
+
+// The slot a piece is in
+int corner_at(Cubies const &state, int piece)
+{
+    return (int)(find(state.cp.begin(), state.cp.end(), piece) - state.cp.begin());
+}
+int edge_at(Cubies const &state, int piece)
+{
+    return (int)(find(state.ep.begin(), state.ep.end(), piece) - state.ep.begin());
+}
+
+// The index of the slot among the slots
+int index_of(uint8_t const (&slots)[4], int slot) { return (int)(find(begin(slots), end(slots), slot) - begin(slots)); }
+
+// A state with unknown pieces (NONE) but for those an index is about
+Cubies unknown()
+{
+    Cubies state;
+    state.cp.fill(NONE);
+    state.ep.fill(NONE);
+    return state;
+}
+
+int rank(array<uint8_t, 4> const &permutation) // of 0..3, lexicographically
+{
+    int result = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int smaller = 0;
+        for (int j = i + 1; j < 4; j++)
+            smaller += permutation[j] < permutation[i];
+        result = result * (4 - i) + smaller;
+    }
+    return result;
+}
+
+array<uint8_t, 4> unrank(int rank)
+{
+    array<uint8_t, 4> result;
+    array<int, 4> digits;
+    for (int i = 3; i >= 0; i--)
+    {
+        digits[i] = rank % (4 - i);
+        rank /= 4 - i;
+    }
+    vector<uint8_t> left = {0, 1, 2, 3};
+    for (int i = 0; i < 4; i++)
+    {
+        result[i] = left[digits[i]];
+        left.erase(left.begin() + digits[i]);
+    }
+    return result;
+}
+
+int pair_index(Cubies const &state, int pair)
+{
+    int corner = corner_at(state, PAIRS[pair][0]), edge = edge_at(state, PAIRS[pair][1]);
+    return (corner * 3 + state.co[corner]) * 24 + edge * 2 + state.eo[edge];
+}
+
+Cubies pair_state(int index, int pair)
+{
+    auto state = unknown();
+    state.cp[index / 24 / 3] = PAIRS[pair][0];
+    state.co[index / 24 / 3] = (uint8_t)(index / 24 % 3);
+    state.ep[index % 24 / 2] = PAIRS[pair][1];
+    state.eo[index % 24 / 2] = (uint8_t)(index % 2);
+    return state;
+}
+
+int oll_index(Cubies const &state)
+{
+    int twists = 0, flips = 0;
+    for (int k = 3; k >= 0; k--)
+    {
+        twists = twists * 3 + state.co[TOP_CORNERS[k]];
+        flips = flips * 2 + state.eo[TOP_EDGES[k]];
+    }
+    return flips * 81 + twists;
+}
+
+Cubies oll_state(int index)
+{
+    Cubies state;
+    for (int k = 0, twists = index % 81, flips = index / 81; k < 4; k++, twists /= 3, flips /= 2)
+    {
+        state.co[TOP_CORNERS[k]] = (uint8_t)(twists % 3);
+        state.eo[TOP_EDGES[k]] = (uint8_t)(flips % 2);
+    }
+    return state;
+}
+
+int pll_index(Cubies const &state)
+{
+    array<uint8_t, 4> corners, edges;
+    for (int k = 0; k < 4; k++)
+    {
+        corners[k] = (uint8_t)index_of(TOP_CORNERS, state.cp[TOP_CORNERS[k]]);
+        edges[k] = (uint8_t)index_of(TOP_EDGES, state.ep[TOP_EDGES[k]]);
+    }
+    return rank(corners) * 24 + rank(edges);
+}
+
+Cubies pll_state(int index)
+{
+    Cubies state;
+    auto corners = unrank(index / 24), edges = unrank(index % 24);
+    for (int k = 0; k < 4; k++)
+    {
+        state.cp[TOP_CORNERS[k]] = TOP_CORNERS[corners[k]];
+        state.ep[TOP_EDGES[k]] = TOP_EDGES[edges[k]];
+    }
+    return state;
+}
+
+// Dijkstra, backwards from solved: the state before a generator is the state after it, then the generator undone
+Table cheapest(int size, vector<Algorithm> const &generators, function<int(Cubies const &)> const &index,
+               function<Cubies(int)> const &state)
+{
+    Table table = {vector<uint16_t>(size, UNREACHED), vector<uint8_t>(size, NONE)};
+    using Entry = pair<uint16_t, int>;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> queue;
+    auto goal = index(Cubies());
+    table.cost[goal] = 0;
+    queue.emplace(0, goal);
+    while (!queue.empty())
+    {
+        auto entry = queue.top();
+        queue.pop();
+        if (entry.first > table.cost[entry.second])
+            continue;
+        auto after = state(entry.second);
+        for (size_t g = 0; g < generators.size(); g++)
+        {
+            auto before = index(after * generators[g].inverse);
+            auto cost = (uint16_t)(entry.first + generators[g].steps.size());
+            if (cost < table.cost[before])
+            {
+                table.cost[before] = cost;
+                table.next[before] = (uint8_t)g;
+                queue.emplace(cost, before);
+            }
+        }
+    }
+    return table;
+}
+
+// Appends the steps, merging turns of the same face where they meet (and dropping those that cancel out)
+void append(vector<Solver::Step> &steps, vector<Solver::Step> const &more)
+{
+    for (auto const &step : more)
+    {
+        if (steps.empty() || get<0>(step) != Solver::Turn || get<0>(steps.back()) != Solver::Turn ||
+            get<1>(steps.back()) != get<1>(step))
+        {
+            steps.push_back(step);
+            continue;
+        }
+        int n = ((get<2>(steps.back()) + get<2>(step)) % 4 + 4) % 4;
+        if (n == 0)
+            steps.pop_back();
+        else
+            get<2>(steps.back()) = n == 3 ? -1 : n;
+    }
+}
+
+// The cases of a table, compiled: the generators from each state to solved, one after the other
+vector<Case> compiled(Table const &table, vector<Algorithm> const &generators,
+                      function<int(Cubies const &)> const &index, function<Cubies(int)> const &state)
+{
+    vector<Case> cases(table.cost.size());
+    auto goal = index(Cubies());
+    for (int i = 0; i < (int)cases.size(); i++)
+    {
+        if (table.cost[i] == UNREACHED)
+            continue;
+        cases[i].known = true;
+        auto current = state(i);
+        for (int at = i; at != goal; at = index(current))
+        {
+            auto const &generator = generators[table.next[at]];
+            append(cases[i].steps, generator.steps);
+            cases[i].effect = cases[i].effect * generator.effect;
+            current = current * generator.effect;
+        }
+    }
+    return cases;
+}
+
+// U turns, then the algorithms, which must keep the first two layers
+vector<Algorithm> last_layer_generators(vector<string> const &algorithms)
+{
+    vector<Algorithm> result;
+    for (int n : TURNS)
+        result.push_back(algorithm({make_tuple(Solver::Turn, Rubiks::UP, n)}));
+    for (auto const &notation : algorithms)
+    {
+        result.push_back(algorithm(from_notation(notation)));
+        if (!keeps_f2l(result.back().effect))
+            throw logic_error("cfop: algorithm doesn't keep the first two layers: " + notation);
+    }
+    return result;
+}
+
+Tables const &tables()
+{
+    static auto const tables = [] {
+        Tables t;
+
+        // Cross: breadth-first from solved, by where each turn takes each edge
+        for (int m = 0; m < MOVES; m++)
+        {
+            auto const &turn = Cubies::turn((Rubiks::Face)(m / 3 * 9), TURNS[m % 3]);
+            for (int slot = 0; slot < 12; slot++)
+            {
+                int to = (int)(find(turn.ep.begin(), turn.ep.end(), slot) - turn.ep.begin());
+                for (int flip = 0; flip < 2; flip++)
+                    t.edge_to[m][slot * 2 + flip] = to * 2 + (flip + turn.eo[to]) % 2;
+            }
+        }
+        t.cross.assign(CROSS_STATES, NONE);
+        vector<int> frontier = {(((CROSS_EDGES[0] * 2) * 24 + CROSS_EDGES[1] * 2) * 24 + CROSS_EDGES[2] * 2) * 24 +
+                                CROSS_EDGES[3] * 2};
+        t.cross[frontier[0]] = 0;
+        for (uint8_t depth = 1; !frontier.empty(); depth++)
+        {
+            vector<int> next;
+            for (int index : frontier)
+                for (int m = 0; m < MOVES; m++)
+                {
+                    int moved = 0;
+                    for (int k = 0, rest = index, unit = 24 * 24 * 24; k < 4; k++, rest %= unit, unit /= 24)
+                        moved = moved * 24 + t.edge_to[m][rest / unit];
+                    if (t.cross[moved] == NONE)
+                    {
+                        t.cross[moved] = depth;
+                        next.push_back(moved);
+                    }
+                }
+            frontier.swap(next);
+        }
+
+        // F2L: U turns, and the triggers, each of which only takes one slot's pair out and back; of those, the ones
+        // that keep the pairs done
+        vector<Algorithm> macros;
+        for (int n : TURNS)
+            macros.push_back(algorithm({make_tuple(Solver::Turn, Rubiks::UP, n)}));
+        for (auto side : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT})
+            for (int way : {1, -1})
+                for (int n : TURNS)
+                    macros.push_back(algorithm({make_tuple(Solver::Turn, side, way),
+                                                make_tuple(Solver::Turn, Rubiks::UP, n),
+                                                make_tuple(Solver::Turn, side, -way)}));
+        for (int pair = 0; pair < 4; pair++)
+            for (int todo = 0; todo < 16; todo++)
+            {
+                if ((todo & (1 << pair)) == 0)
+                    continue;
+                auto &f2l = t.f2l[pair][todo];
+                for (auto const &macro : macros)
+                {
+                    bool keeps = true;
+                    for (int other = 0; other < 4; other++)
+                        if ((todo & (1 << other)) == 0)
+                            keeps = keeps && keeps_corner(macro.effect, PAIRS[other][0]) &&
+                                    keeps_edge(macro.effect, PAIRS[other][1]);
+                    if (keeps)
+                        f2l.macros.push_back(macro);
+                }
+                f2l.table = cheapest(
+                    PAIR_STATES, f2l.macros, [pair](Cubies const &s) { return pair_index(s, pair); },
+                    [pair](int i) { return pair_state(i, pair); });
+            }
+
+        // OLL and PLL
+        auto oll = last_layer_generators(cfop::oll_algorithms());
+        t.oll = compiled(cheapest(OLL_STATES, oll, oll_index, oll_state), oll, oll_index, oll_state);
+        auto pll = last_layer_generators(cfop::pll_algorithms());
+        for (size_t g = 3; g < pll.size(); g++)
+            if (oll_index(pll[g].effect) != 0)
+                throw logic_error("cfop: PLL algorithm doesn't keep the last layer oriented: " +
+                                  notation(pll[g].steps));
+        t.pll = compiled(cheapest(PLL_STATES, pll, pll_index, pll_state), pll, pll_index, pll_state);
+        return t;
+    }();
+    return tables;
+}
+
+vector<Solver::Step> applied(Case const &c, Cubies &state, char const *stage)
+{
+    if (!c.known)
+        throw logic_error(string("cfop: no ") + stage + " case for the state");
+    state = state * c.effect;
+    return c.steps;
+}
+
+// The last layer as a whole: its permutation, then its twists and flips
+int ll_index(Cubies const &state) { return pll_index(state) * OLL_STATES + oll_index(state); }
+
+Cubies ll_state(int index)
+{
+    auto state = pll_state(index / OLL_STATES), oriented = oll_state(index % OLL_STATES);
+    state.co = oriented.co;
+    state.eo = oriented.eo;
+    return state;
+}
+
+// The colors of the last layer's facelets (those of its pieces: the top 21 but the center), as the faces of the
+// centers of those colors, 3 bits each; in the order of the slots' nibbles, corners first
+uint64_t facelet_key(Rubiks const &cube)
+{
+    array<uint8_t, 256> face;
+    face.fill(7); // no color of a center
+    for (int f = 0; f < 6; f++)
+        face[(unsigned char)cube.color((Rubiks::Face)(f * 9), Rubiks::CC)] = (uint8_t)f;
+
+    uint64_t key = 0;
+    auto add = [&](int pos) {
+        key = key << 3 | face[(unsigned char)cube.color((Rubiks::Face)(pos / 9 * 9), (Rubiks::Cell)(pos % 9))];
+    };
+    for (auto slot : TOP_CORNERS)
+        for (int pos : Rubiks::corner_slots()[slot])
+            add(pos);
+    for (auto slot : TOP_EDGES)
+        for (int pos : Rubiks::edge_slots()[slot])
+            add(pos);
+    return key;
+}
+
+// The same for a state: nibble n of a slot shows nibble n - orientation of the piece in it (see Cubies)
+uint64_t facelet_key(Cubies const &state)
+{
+    auto const &corners = Rubiks::corner_slots();
+    auto const &edges = Rubiks::edge_slots();
+    uint64_t key = 0;
+    for (auto slot : TOP_CORNERS)
+        for (int n = 0; n < 3; n++)
+            key = key << 3 | corners[state.cp[slot]][(n + 3 - state.co[slot]) % 3] / 9;
+    for (auto slot : TOP_EDGES)
+        for (int n = 0; n < 2; n++)
+            key = key << 3 | edges[state.ep[slot]][(n + state.eo[slot]) % 2] / 9;
+    return key;
+}
+
+// All states of the last layer, with the cheapest way by U turns and the OLL and PLL algorithms
+struct LastLayer {
+    vector<Algorithm> generators;
+    Table table;                         // by state
+    unordered_map<uint64_t, int> states; // by facelet key, those reachable
+};
+
+LastLayer const &last_layer_table()
+{
+    static auto const table = [] {
+        LastLayer t;
+        auto algorithms = cfop::oll_algorithms();
+        algorithms.insert(algorithms.end(), cfop::pll_algorithms().begin(), cfop::pll_algorithms().end());
+        t.generators = last_layer_generators(algorithms);
+        t.table = cheapest(LL_STATES, t.generators, ll_index, ll_state);
+        for (int index = 0; index < LL_STATES; index++)
+            if (t.table.cost[index] != UNREACHED)
+                t.states.emplace(facelet_key(ll_state(index)), index);
+        return t;
+    }();
+    return table;
+}
+
+} // namespace
+
+namespace cfop {
+
+vector<Solver::Step> cross(Cubies &state)
+{
+    auto const &t = tables();
+    int index = 0;
+    for (auto piece : CROSS_EDGES)
+    {
+        int slot = edge_at(state, piece);
+        index = index * 24 + slot * 2 + state.eo[slot];
+    }
+
+    vector<Solver::Step> steps;
+    while (t.cross[index] > 0)
+    {
+        for (int m = 0; m < MOVES; m++)
+        {
+            int moved = 0;
+            for (int k = 0, rest = index, unit = 24 * 24 * 24; k < 4; k++, rest %= unit, unit /= 24)
+                moved = moved * 24 + t.edge_to[m][rest / unit];
+            if (t.cross[moved] < t.cross[index])
+            {
+                steps.push_back(make_tuple(Solver::Turn, (Rubiks::Face)(m / 3 * 9), TURNS[m % 3]));
+                state = state * Cubies::turn(get<1>(steps.back()), get<2>(steps.back()));
+                index = moved;
+                break;
+            }
+        }
+    }
+    return steps;
+}
+
+vector<Solver::Step> f2l_pair(Cubies &state)
+{
+    auto const &t = tables();
+    int todo = 0;
+    for (int pair = 0; pair < 4; pair++)
+        if (!keeps_corner(state, PAIRS[pair][0]) || !keeps_edge(state, PAIRS[pair][1]))
+            todo |= 1 << pair;
+    if (todo == 0)
+        return {};
+
+    int best = -1;
+    for (int pair = 0; pair < 4; pair++)
+        if ((todo & (1 << pair)) != 0 &&
+            (best < 0 || t.f2l[pair][todo].table.cost[pair_index(state, pair)] <
+                             t.f2l[best][todo].table.cost[pair_index(state, best)]))
+            best = pair;
+
+    auto const &f2l = t.f2l[best][todo];
+    auto const &table = f2l.table;
+    vector<Solver::Step> steps;
+    for (int index = pair_index(state, best); table.cost[index] > 0; index = pair_index(state, best))
+    {
+        if (table.cost[index] == UNREACHED)
+            throw logic_error("cfop: no F2L case for the state");
+        auto const &macro = f2l.macros[table.next[index]];
+        steps.insert(steps.end(), macro.steps.begin(), macro.steps.end());
+        state = state * macro.effect;
+    }
+    return steps;
+}
+
+vector<Solver::Step> oll(Cubies &state) { return applied(tables().oll[oll_index(state)], state, "OLL"); }
+
+vector<Solver::Step> pll(Cubies &state) { return applied(tables().pll[pll_index(state)], state, "PLL"); }
+
+vector<string> const &oll_algorithms()
+{
+    static vector<string> const algorithms(begin(OLL), end(OLL));
+    return algorithms;
+}
+
+vector<string> const &pll_algorithms()
+{
+    static vector<string> const algorithms(begin(PLL), end(PLL));
+    return algorithms;
+}
+
+vector<Solver::Step> last_layer(Rubiks const &cube)
+{
+    auto const &t = last_layer_table();
+    auto found = t.states.find(facelet_key(cube));
+    if (found == t.states.end())
+        throw logic_error("cfop: no last layer case for the cube, or the first two layers not solved");
+
+    vector<Solver::Step> steps;
+    auto state = ll_state(found->second);
+    for (int index = found->second; t.table.cost[index] > 0; index = ll_index(state))
+    {
+        auto const &generator = t.generators[t.table.next[index]];
+        append(steps, generator.steps);
+        state = state * generator.effect;
+    }
+    return steps;
+}
+
+void prepare() { tables(); }
+
+} // namespace cfop
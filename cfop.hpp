@@ -0,0 +1,51 @@
+#pragma once
+
+#include "cubie.hpp"
+#include "solver.hpp"
+#include <string>
+#include <vector>
+
+// CFOP (Fridrich), see https://ruwix.com/the-rubiks-cube/advanced-cfop-fridrich/, by table lookup
+//
+// Each stage recognizes its case by the pieces it is about, as an index into a table, and the table has the turns
+// that solve the case. The cross (the edges of DOWN) is solved in the fewest turns, by a table of the distance to
+// solved of all their states. The F2L pairs (a corner of DOWN and the edge above it) are solved one at a time, the
+// cheapest next: a table per pair, and per set of pairs still to solve, has the cheapest way by U turns and triggers
+// (a side turned, U turned, the side turned back), of those that keep the cross and the pairs done. OLL recognizes
+// the twists and flips of the last layer, PLL its permutation, and both tables have the cheapest way by U turns
+// (so AUF is in the table) and the algorithms in cfop.cpp, compiled into one sequence and one cubie state per case.
+// There is an algorithm for each of the 57 OLL and 21 PLL cases, so a case takes its own plus AUF, unless combining
+// others is cheaper.
+// The algorithms are checked to keep the first two layers when the tables are built.
+//
+// The tables take less than a MB and are built on first use, in tens of milliseconds.
+//
+namespace cfop {
+
+// The turns that solve the cross on DOWN; they are applied to the state
+auto cross(Cubies &state) -> std::vector<Solver::Step>;
+
+// The turns that solve the cheapest next F2L pair, none if all are done; the cross must be solved. They are applied
+// to the state.
+auto f2l_pair(Cubies &state) -> std::vector<Solver::Step>;
+
+// The turns that orient the last layer; the first two layers must be solved. They are applied to the state.
+auto oll(Cubies &state) -> std::vector<Solver::Step>;
+
+// The turns that permute the last layer; it must be oriented, and the rest solved. They are applied to the state.
+auto pll(Cubies &state) -> std::vector<Solver::Step>;
+
+// The turns that solve the last layer in one look, recognized by the colors of its 21 facelets (UP, and the top row of
+// each side); the first two layers must be solved. A table of all 62208 states of the last layer, hashed by those
+// colors, has the cheapest way for each by U turns and the OLL and PLL algorithms. It is built on first use, in a few
+// tenths of a second.
+auto last_layer(Rubiks const &cube) -> std::vector<Solver::Step>;
+
+// The algorithms the OLL and PLL tables are built from, in the usual notation
+auto oll_algorithms() -> std::vector<std::string> const &;
+auto pll_algorithms() -> std::vector<std::string> const &;
+
+// Builds the tables, if not yet built
+void prepare();
+
+} // namespace cfop
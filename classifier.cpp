@@ -0,0 +1,436 @@
+#include "classifier.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+using Slots = vector<vector<int>>;             // positions of the nibbles of each piece, see Rubiks::*_slots
+using Costs = vector<vector<array<double, 3>>>; // per slot, per piece (by its home slot) and rotation
+using Known = array<bool, 54>;                  // readings to go by
+
+// Pieces in the slots, and their rotations: slot nibble m shows the piece's nibble (m + rotation) % k
+struct Pieces {
+    vector<int> piece;
+    vector<int> rotation;
+};
+
+struct Assignment {
+    Pieces edges;
+    Pieces corners;
+    double cost;
+};
+
+template <size_t N, size_t K> Slots slots_of(array<array<int, K>, N> const &slots)
+{
+    Slots result;
+    for (auto const &slot : slots)
+        result.push_back(vector<int>(slot.begin(), slot.end()));
+    return result;
+}
+
+double distance(Rgb const &a, Rgb const &b)
+{
+    return (a.r - b.r) * (a.r - b.r) + (a.g - b.g) * (a.g - b.g) + (a.b - b.b) * (a.b - b.b);
+}
+
+// Solves the assignment problem for a square cost matrix (Hungarian method), returns the column of each row
+vector<int> hungarian(vector<vector<double>> const &cost)
+{
+    size_t n = cost.size();
+    double const inf = numeric_limits<double>::infinity();
+    vector<double> u(n + 1), v(n + 1);
+    vector<size_t> p(n + 1), way(n + 1);
+
+    for (size_t i = 1; i <= n; i++)
+    {
+        p[0] = i;
+        size_t j0 = 0;
+        vector<double> minv(n + 1, inf);
+        vector<bool> used(n + 1, false);
+        do
+        {
+            used[j0] = true;
+            size_t i0 = p[j0], j1 = 0;
+            double delta = inf;
+            for (size_t j = 1; j <= n; j++)
+            {
+                if (used[j])
+                    continue;
+                double cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+                if (cur < minv[j])
+                {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (size_t j = 0; j <= n; j++)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        do
+        {
+            size_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    vector<int> result(n);
+    for (size_t j = 1; j <= n; j++)
+        result[p[j] - 1] = (int)j - 1;
+    return result;
+}
+
+// Cost of each piece in each slot and rotation: how far the known readings are from the clusters of the colors
+// they would get; forbid rules out one color (cluster) at one position
+Costs costs_of(Slots const &slots, Readings const &readings, Known const &known, array<Rgb, 6> const &centroids,
+               int forbid_pos, int forbid_cluster)
+{
+    double const inf = numeric_limits<double>::infinity();
+    size_t n = slots.size();
+    size_t k = slots[0].size();
+    Costs costs(n, vector<array<double, 3>>(n));
+
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t r = 0; r < 3; r++)
+            {
+                double c = r < k ? 0.0 : inf;
+                for (size_t m = 0; m < k && r < k; m++)
+                {
+                    int pos = slots[i][m];
+                    int cluster = slots[j][(m + r) % k] / 9;
+                    if (pos == forbid_pos && cluster == forbid_cluster)
+                        c = inf;
+                    else if (known[pos])
+                        c += distance(readings[pos], centroids[cluster]);
+                }
+                costs[i][j][r] = c;
+            }
+        }
+    }
+    return costs;
+}
+
+int best_rotation(array<double, 3> const &costs)
+{
+    return (int)(min_element(costs.begin(), costs.end()) - costs.begin());
+}
+
+Pieces best_pieces(Costs const &costs)
+{
+    size_t n = costs.size();
+    vector<vector<double>> best(n, vector<double>(n));
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+            best[i][j] = costs[i][j][best_rotation(costs[i][j])];
+    }
+
+    Pieces pieces;
+    pieces.piece = hungarian(best);
+    for (size_t i = 0; i < n; i++)
+        pieces.rotation.push_back(best_rotation(costs[i][pieces.piece[i]]));
+    return pieces;
+}
+
+double cost_of(Costs const &costs, Pieces const &pieces)
+{
+    double cost = 0.0;
+    for (size_t i = 0; i < costs.size(); i++)
+        cost += costs[i][pieces.piece[i]][pieces.rotation[i]];
+    return cost;
+}
+
+// Swaps the pieces of the two slots (of one kind) for which that costs least; fixes the permutation parity
+void fix_parity(Assignment &assignment, Costs const &edge_costs, Costs const &corner_costs)
+{
+    double best = numeric_limits<double>::infinity();
+    Pieces *best_pieces = nullptr;
+    size_t best_i = 0, best_l = 0;
+
+    for (auto kind : {make_pair(&assignment.edges, &edge_costs), make_pair(&assignment.corners, &corner_costs)})
+    {
+        auto const &p = kind.first->piece;
+        auto const &r = kind.first->rotation;
+        auto const &c = *kind.second;
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            for (size_t l = i + 1; l < p.size(); l++)
+            {
+                double delta = c[i][p[l]][best_rotation(c[i][p[l]])] + c[l][p[i]][best_rotation(c[l][p[i]])] -
+                               c[i][p[i]][r[i]] - c[l][p[l]][r[l]];
+                if (delta < best)
+                {
+                    best = delta;
+                    best_pieces = kind.first;
+                    best_i = i;
+                    best_l = l;
+                }
+            }
+        }
+    }
+
+    if (best_pieces == nullptr)
+        return;
+    auto const &c = best_pieces == &assignment.edges ? edge_costs : corner_costs;
+    auto &p = best_pieces->piece;
+    swap(p[best_i], p[best_l]);
+    best_pieces->rotation[best_i] = best_rotation(c[best_i][p[best_i]]);
+    best_pieces->rotation[best_l] = best_rotation(c[best_l][p[best_l]]);
+}
+
+// Rotates one or two pieces (of one kind) for which that costs least, such that the sum of the orientations of all
+// is a multiple of k (2 for edges, 3 for corners)
+void fix_orientation(Pieces &pieces, Costs const &costs, int k)
+{
+    // Orientation of a piece: the slot nibble its reference nibble is on
+    auto orientation = [k](int rotation) { return (k - rotation) % k; };
+
+    int sum = 0;
+    for (auto rotation : pieces.rotation)
+        sum += orientation(rotation);
+    if (sum % k == 0)
+        return;
+
+    auto const &p = pieces.piece;
+    auto const &r = pieces.rotation;
+    double best = numeric_limits<double>::infinity();
+    size_t best_i = 0, best_l = 0;
+    int best_ri = r[0], best_rl = r[0];
+
+    for (size_t i = 0; i < p.size(); i++)
+    {
+        for (size_t l = i; l < p.size(); l++) // a single piece when l == i
+        {
+            for (int ri = 0; ri < k; ri++)
+            {
+                for (int rl = 0; rl < k; rl++)
+                {
+                    if (l == i && rl != ri)
+                        continue;
+
+                    int changed = sum - orientation(r[i]) + orientation(ri);
+                    double delta = costs[i][p[i]][ri] - costs[i][p[i]][r[i]];
+                    if (l != i)
+                    {
+                        changed += orientation(rl) - orientation(r[l]);
+                        delta += costs[l][p[l]][rl] - costs[l][p[l]][r[l]];
+                    }
+                    if (changed % k == 0 && delta < best)
+                    {
+                        best = delta;
+                        best_i = i;
+                        best_l = l;
+                        best_ri = ri;
+                        best_rl = rl;
+                    }
+                }
+            }
+        }
+    }
+
+    pieces.rotation[best_i] = best_ri;
+    pieces.rotation[best_l] = best_rl;
+}
+
+// The most likely valid assignment (of which the cost is infinite if there is none)
+Assignment solve(Readings const &readings, Known const &known, array<Rgb, 6> const &centroids, int forbid_pos = -1,
+                 int forbid_cluster = -1)
+{
+    static auto const edges = slots_of(Rubiks::edge_slots());
+    static auto const corners = slots_of(Rubiks::corner_slots());
+
+    auto edge_costs = costs_of(edges, readings, known, centroids, forbid_pos, forbid_cluster);
+    auto corner_costs = costs_of(corners, readings, known, centroids, forbid_pos, forbid_cluster);
+
+    Assignment assignment;
+    assignment.edges = best_pieces(edge_costs);
+    assignment.corners = best_pieces(corner_costs);
+    if (Rubiks::parity(assignment.edges.piece) != Rubiks::parity(assignment.corners.piece))
+        fix_parity(assignment, edge_costs, corner_costs);
+    fix_orientation(assignment.edges, edge_costs, 2);
+    fix_orientation(assignment.corners, corner_costs, 3);
+
+    assignment.cost = cost_of(edge_costs, assignment.edges) + cost_of(corner_costs, assignment.corners);
+    return assignment;
+}
+
+// The cluster (the face of the color) of each nibble
+array<int, 54> clusters_of(Assignment const &assignment)
+{
+    static auto const edges = slots_of(Rubiks::edge_slots());
+    static auto const corners = slots_of(Rubiks::corner_slots());
+
+    array<int, 54> clusters;
+    for (int face = 0; face < 6; face++)
+        clusters[face * 9 + Rubiks::CC] = face;
+
+    for (auto kind : {make_pair(&edges, &assignment.edges), make_pair(&corners, &assignment.corners)})
+    {
+        auto const &slots = *kind.first;
+        auto const &pieces = *kind.second;
+        size_t k = slots[0].size();
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            auto const &home = slots[pieces.piece[i]];
+            for (size_t m = 0; m < k; m++)
+                clusters[slots[i][m]] = home[(m + pieces.rotation[i]) % k] / 9;
+        }
+    }
+    return clusters;
+}
+
+} // namespace
+
+Rgb reference(Rubiks::Color color)
+{
+    switch (color)
+    {
+    case Rubiks::RED:
+        return {180, 40, 25};
+    case Rubiks::ORANGE:
+        return {225, 85, 35};
+    case Rubiks::GREEN:
+        return {40, 140, 60};
+    case Rubiks::BLUE:
+        return {30, 60, 130};
+    case Rubiks::YELLOW:
+        return {230, 210, 60};
+    case Rubiks::WHITE:
+    default:
+        return {250, 260, 240};
+    }
+}
+
+Classification classify(Readings const &readings)
+{
+    Known known;
+    array<Rgb, 6> centroids;
+    for (int pos = 0; pos < 54; pos++)
+        known[pos] = !missing(readings[pos]);
+    for (int face = 0; face < 6; face++)
+    {
+        if (!known[face * 9 + Rubiks::CC])
+            throw runtime_error("classify: the centers must have been read");
+        centroids[face] = readings[face * 9 + Rubiks::CC];
+    }
+
+    auto update_centroids = [&](array<int, 54> const &clusters) {
+        array<Rgb, 6> sums = {};
+        array<int, 6> counts = {};
+        for (int pos = 0; pos < 54; pos++)
+        {
+            if (!known[pos])
+                continue;
+            auto &sum = sums[clusters[pos]];
+            sum.r += readings[pos].r;
+            sum.g += readings[pos].g;
+            sum.b += readings[pos].b;
+            counts[clusters[pos]]++;
+        }
+        for (int face = 0; face < 6; face++)
+            centroids[face] = {sums[face].r / counts[face], sums[face].g / counts[face], sums[face].b / counts[face]};
+    };
+
+    Assignment assignment = solve(readings, known, centroids);
+    auto clusters = clusters_of(assignment);
+    for (int iteration = 0; iteration < 10; iteration++)
+    {
+        update_centroids(clusters);
+        assignment = solve(readings, known, centroids);
+        auto previous = clusters;
+        clusters = clusters_of(assignment);
+        if (clusters == previous)
+            break;
+    }
+
+    // Don't trust readings that are not clearly closer to their own cluster than to any other
+    bool distrust = false;
+    for (int pos = 0; pos < 54; pos++)
+    {
+        if (!known[pos] || pos % 9 == Rubiks::CC)
+            continue;
+
+        double own = distance(readings[pos], centroids[clusters[pos]]);
+        double other = numeric_limits<double>::infinity();
+        for (int face = 0; face < 6; face++)
+        {
+            if (face != clusters[pos])
+                other = min(other, distance(readings[pos], centroids[face]));
+        }
+        if (own > other / 4.0) // more than half as far
+        {
+            known[pos] = false;
+            distrust = true;
+        }
+    }
+    if (distrust)
+    {
+        assignment = solve(readings, known, centroids);
+        clusters = clusters_of(assignment);
+    }
+
+    // An unknown color is ambiguous if another one is almost as likely in a valid cube: no further away than one
+    // reading halfway between two clusters
+    double margin = numeric_limits<double>::infinity();
+    for (int a = 0; a < 6; a++)
+    {
+        for (int b = a + 1; b < 6; b++)
+            margin = min(margin, distance(centroids[a], centroids[b]) / 4.0);
+    }
+
+    Classification result = {Rubiks(), {}};
+    for (int pos = 0; pos < 54; pos++)
+    {
+        if (!known[pos] && solve(readings, known, centroids, pos, clusters[pos]).cost < assignment.cost + margin)
+            result.ambiguous.push_back(pos);
+    }
+
+    // Name the clusters, all at once, after the reference colors closest to them
+    array<Rubiks::Color, 6> names = {Rubiks::RED,   Rubiks::ORANGE, Rubiks::GREEN,
+                                     Rubiks::BLUE,  Rubiks::YELLOW, Rubiks::WHITE};
+    sort(names.begin(), names.end());
+    auto best = names;
+    double best_cost = numeric_limits<double>::infinity();
+    do
+    {
+        double cost = 0.0;
+        for (int face = 0; face < 6; face++)
+            cost += distance(centroids[face], reference(names[face]));
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best = names;
+        }
+    } while (next_permutation(names.begin(), names.end()));
+
+    string lrbfdu(54, ' ');
+    for (int pos = 0; pos < 54; pos++)
+        lrbfdu[pos] = best[clusters[pos]];
+    result.cube = Rubiks(lrbfdu);
+    return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rubiks.hpp"
+#include <array>
+#include <vector>
+
+// Raw reading of the color sensor (in RGB-RAW mode)
+struct Rgb {
+    double r, g, b;
+};
+
+// Readings of all facelets, ordered as the state of a Rubiks (lrbfdu)
+using Readings = std::array<Rgb, 54>;
+
+// A facelet that could not be read at all
+constexpr Rgb MISSING = {-1.0, -1.0, -1.0};
+inline bool missing(Rgb const &reading) { return reading.r < 0.0; }
+
+struct Classification {
+    Rubiks cube;                // the most likely valid cube
+    std::vector<int> ambiguous; // positions that could be another color as well, worth reading again
+};
+
+// Typical raw reading of a sticker of the given color under the EV3 color sensor
+auto reference(Rubiks::Color color) -> Rgb;
+
+// Classifies the readings of a scanned cube into the most likely valid cube
+//
+// Rather than naming each reading's color on its own, which confuses red with orange and white with yellow, all
+// readings are classified at once: the six centers seed a color cluster each, and the pieces of a real cube (each a
+// combination of center colors) are assigned to the edge and corner slots such that the readings are closest to the
+// clusters they end up in, under the invariants of a solvable cube (corner twist, edge flip, permutation parity).
+// The clusters move to the mean of their readings, and that repeats until the assignment is stable. Finally, the
+// clusters are named after the reference colors closest to them.
+//
+// Readings that are missing, or not clearly closer to their cluster than to any other, are not trusted; their
+// colors are inferred from the rest. Those that could still be another color in a valid cube nearly as likely are
+// reported as ambiguous. The centers must have been read.
+//
+auto classify(Readings const &readings) -> Classification;
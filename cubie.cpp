@@ -0,0 +1,160 @@
+#include "cubie.hpp"
+#include "scramble.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t FACES = 6;
+
+// Which face each color belongs to, by the centers
+array<int, 256> homes_of(Rubiks const &cube)
+{
+    array<int, 256> home;
+    home.fill(-1);
+    for (int face = Rubiks::LEFT; face <= Rubiks::UP; face += 9)
+        home[(unsigned char)cube.color((Rubiks::Face)face, Rubiks::CC)] = face;
+    return home;
+}
+
+// Finds the piece whose home faces are those of the colors on the slot's nibbles, and how far it is rotated there:
+// the color on nibble (m + r) % k is the one of the piece's nibble m
+template <size_t K, size_t N>
+void identify(array<int, K> const &faces, array<array<int, K>, N> const &slots, uint8_t &piece, uint8_t &orientation)
+{
+    for (size_t r = 0; r < K; r++)
+        for (size_t j = 0; j < N; j++)
+        {
+            bool match = true;
+            for (size_t m = 0; m < K && match; m++)
+                match = faces[(m + r) % K] == slots[j][m] / 9 * 9;
+            if (match)
+            {
+                piece = (uint8_t)j;
+                orientation = (uint8_t)r;
+                return;
+            }
+        }
+    throw invalid_argument("cubies: no such piece");
+}
+
+} // namespace
+
+Cubies::Cubies()
+{
+    for (uint8_t i = 0; i < 8; i++)
+        cp[i] = i, co[i] = 0;
+    for (uint8_t i = 0; i < 12; i++)
+        ep[i] = i, eo[i] = 0;
+}
+
+Cubies::Cubies(Rubiks const &cube)
+{
+    auto home = homes_of(cube);
+    auto face_at = [&](int pos) {
+        return home[(unsigned char)cube.color((Rubiks::Face)(pos / 9 * 9), (Rubiks::Cell)(pos % 9))];
+    };
+
+    auto const &corners = Rubiks::corner_slots();
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        array<int, 3> faces = {{face_at(corners[i][0]), face_at(corners[i][1]), face_at(corners[i][2])}};
+        identify(faces, corners, cp[i], co[i]);
+    }
+    auto const &edges = Rubiks::edge_slots();
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        array<int, 2> faces = {{face_at(edges[i][0]), face_at(edges[i][1])}};
+        identify(faces, edges, ep[i], eo[i]);
+    }
+}
+
+Cubies Cubies::random(Xoshiro256 &random)
+{
+    Cubies state;
+    auto shuffle = [&random](uint8_t *begin, uint32_t n) { // Fisher-Yates
+        for (uint32_t i = n - 1; i > 0; i--)
+            swap(begin[i], begin[random.below(i + 1)]);
+    };
+    shuffle(state.cp.data(), 8);
+    shuffle(state.ep.data(), 12);
+    if (Rubiks::parity(state.cp) != Rubiks::parity(state.ep))
+        swap(state.ep[0], state.ep[1]);
+
+    int twist = 0, flip = 0;
+    for (size_t i = 0; i < 7; i++)
+        twist += state.co[i] = (uint8_t)random.below(3);
+    state.co[7] = (uint8_t)((3 - twist % 3) % 3);
+    for (size_t i = 0; i < 11; i++)
+        flip += state.eo[i] = (uint8_t)random.below(2);
+    state.eo[11] = (uint8_t)(flip % 2);
+    return state;
+}
+
+Cubies const &Cubies::turn(Rubiks::Face face, int n)
+{
+    static auto const turns = [] {
+        array<array<Cubies, 4>, FACES> result;
+        for (int face = Rubiks::LEFT; face <= Rubiks::UP; face += 9)
+            for (int n = 0; n < 4; n++)
+            {
+                Rubiks cube;
+                cube.turn((Rubiks::Face)face, n == 0 ? 4 : n);
+                result[face / 9][n] = Cubies(cube);
+            }
+        return result;
+    }();
+    return turns[face / 9][(n % 4 + 4) % 4];
+}
+
+Cubies Cubies::operator*(Cubies const &other) const
+{
+    Cubies product;
+    for (size_t i = 0; i < 8; i++)
+    {
+        product.cp[i] = cp[other.cp[i]];
+        product.co[i] = (uint8_t)((co[other.cp[i]] + other.co[i]) % 3);
+    }
+    for (size_t i = 0; i < 12; i++)
+    {
+        product.ep[i] = ep[other.ep[i]];
+        product.eo[i] = (uint8_t)((eo[other.ep[i]] + other.eo[i]) % 2);
+    }
+    return product;
+}
+
+bool Cubies::operator==(Cubies const &other) const
+{
+    return cp == other.cp && co == other.co && ep == other.ep && eo == other.eo;
+}
+
+Cubies::Key Cubies::key() const
+{
+    Key key = {0, 0};
+    for (size_t i = 0; i < 12; i++)
+        key.low = key.low << 5 | ep[i] << 1 | eo[i];
+    for (size_t i = 0; i < 8; i++)
+        key.high = key.high << 5 | cp[i] << 2 | co[i];
+    return key;
+}
+
+Rubiks Cubies::facelets(Rubiks const &centers) const
+{
+    string state(54, ' ');
+    for (int face = Rubiks::LEFT; face <= Rubiks::UP; face += 9)
+        state[face + Rubiks::CC] = (char)centers.color((Rubiks::Face)face, Rubiks::CC);
+    auto color_of = [&state](int pos) { return state[pos / 9 * 9 + Rubiks::CC]; };
+
+    auto const &corners = Rubiks::corner_slots();
+    for (size_t i = 0; i < corners.size(); i++)
+        for (size_t m = 0; m < 3; m++)
+            state[corners[i][(m + co[i]) % 3]] = color_of(corners[cp[i]][m]);
+    auto const &edges = Rubiks::edge_slots();
+    for (size_t i = 0; i < edges.size(); i++)
+        for (size_t m = 0; m < 2; m++)
+            state[edges[i][(m + eo[i]) % 2]] = color_of(edges[ep[i]][m]);
+    return Rubiks(state);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "rubiks.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class Xoshiro256;
+
+// The cube as pieces in slots rather than colors on facelets
+//
+// Slots are numbered as in Rubiks::corner_slots and Rubiks::edge_slots. Slot i holds corner piece cp[i] (the piece
+// whose home is slot cp[i]), rotated co[i] nibbles from its reference orientation; the same for edges, flipped or not.
+// A turn is a cubie state of its own (where the turn takes the pieces of a solved cube), and turning is multiplying
+// by it. Searches work on this model, and on coordinates derived from it, as that is much cheaper than facelets.
+//
+struct Cubies {
+    // The state in 100 bits, 5 per piece, to hash or compare states by
+    struct Key {
+        std::uint64_t low, high; // edges, corners
+
+        bool operator==(Key const &other) const { return low == other.low && high == other.high; }
+        bool operator<(Key const &other) const { return high < other.high || (high == other.high && low < other.low); }
+
+        struct Hash {
+            auto operator()(Key const &key) const -> std::size_t
+            {
+                return (std::size_t)((key.low ^ key.high * 0x9e3779b97f4a7c15ull) >> 7);
+            }
+        };
+    };
+
+    std::array<std::uint8_t, 8> cp, co;
+    std::array<std::uint8_t, 12> ep, eo;
+
+    // Solved
+    Cubies();
+
+    // The pieces of the cube, by the colors of its centers; the cube must be valid
+    explicit Cubies(Rubiks const &cube);
+
+    // A state drawn uniformly from all solvable states
+    static auto random(Xoshiro256 &random) -> Cubies;
+
+    // The state a turn takes a solved cube to
+    static auto turn(Rubiks::Face face, int n) -> Cubies const &;
+
+    /*
+        Queries:
+    */
+
+    // This state, then the other applied to it
+    auto operator*(Cubies const &other) const -> Cubies;
+    bool operator==(Cubies const &other) const;
+
+    bool solved() const { return *this == Cubies(); }
+
+    auto key() const -> Key;
+
+    // The colors of the state, with the centers (and so the colors of the pieces) of the cube
+    auto facelets(Rubiks const &centers = Rubiks()) const -> Rubiks;
+};
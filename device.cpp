@@ -1,10 +1,11 @@
 #include "device.hpp"
-#include "ev3dev.h"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <stdexcept>
 #include <thread>
 
 using namespace std;
-using namespace ev3dev;
 
 using NofRotations = int;
 using NofFlips = int;
@@ -22,32 +23,35 @@ std::map<Device::DeviceFace, Device::DeviceFace> table_cw_permutation = {
     {Device::LEFT, Device::BACK},  {Device::RIGHT, Device::FRONT}, {Device::BACK, Device::RIGHT},
     {Device::FRONT, Device::LEFT}, {Device::DOWN, Device::DOWN},   {Device::UP, Device::UP}};
 
-sensor g_sensors[3]{{INPUT_1},  // (1) EV3 touch (device lego-ev3-touch, port
-                                // ev3-ports:in1, mode TOUCH)
-                    {INPUT_2},  // (2) EV3 color (device lego-ev3-color, port
-                                // ev3-ports:in2, mode COL-REFLECT)
-                    {INPUT_4}}; // (4) EV3 infrared (device lego-ev3-ir, port
-                                // ev3-ports:in4, mode IR-PROX)
+constexpr size_t SETTLE_SAMPLES = 5; // a reading at rest is the median of this many samples
 
-motor g_motors[3] = {{OUTPUT_A},  // (1) lego-ev3-l-motor motor on port ev3-ports:outA (BEAM)
-                     {OUTPUT_B},  // (2) lego-ev3-m-motor motor on port ev3-ports:outB (TABLE)
-                     {OUTPUT_C}}; // (3) lego-ev3-m-motor motor on port ev3-ports:outC (SCANNER)
-
-enum Sensors : int { BUTTON, COLOR, CUBE };
-
-enum Actuators : int { BEAM, TURNTABLE, SCANNER };
+// Express n quarter turns as -1, 1 or 2 (0 if the turns cancel out)
+int normalized_turns(int n)
+{
+    n = n % 4;
+    n = n < 0 ? n + 4 : n;
+    return n == 3 ? -1 : n;
+}
 
-void waitidle(motor const &motor)
+// The cell of the face that is up under the sensor (at the scanner's side, E), with the table turned the given
+// number of eighths ccw (<0 cw); from 0 to 315 degrees ccw, the cells come by as E, SE, S, SW, W, NW, N, NE
+int ring_cell(int eighths)
 {
-    while (motor.state().count("running") > 0)
-    {
-        chrono::milliseconds waitfor = chrono::milliseconds(10);
-        this_thread::sleep_for(waitfor);
-    }
+    static Rubiks::Cell const cells[8] = {Rubiks::E, Rubiks::SE, Rubiks::S, Rubiks::SW,
+                                          Rubiks::W, Rubiks::NW, Rubiks::N, Rubiks::NE};
+    return Rubiks::UP + cells[((eighths % 8) + 8) % 8];
 }
 
-Device::Device()
-    : _state({{Rubiks::LEFT, Device::LEFT},
+// Keeps a sampler running while in scope
+struct Sampling {
+    Sampling(Sampler &sampler, Backend::Motor motor) : sampler(sampler) { sampler.start(motor); }
+    ~Sampling() { sampler.stop(); }
+    Sampler &sampler;
+};
+
+Device::Device(shared_ptr<Backend> backend, atomic<bool> const *cancelled)
+    : _backend(backend), _cancelled(cancelled), _color(backend, Backend::COLOR, 3), _scan_mode(SWEEP),
+      _state({{Rubiks::LEFT, Device::LEFT},
               {Rubiks::RIGHT, Device::RIGHT},
               {Rubiks::BACK, Device::BACK},
               {Rubiks::FRONT, Device::FRONT},
@@ -55,42 +59,73 @@ Device::Device()
               {Rubiks::UP, Device::UP}})
 {
     // Init beam
-    motor &beam = g_motors[Actuators::BEAM];
-    beam.reset();
-    beam.set_stop_action("hold");
-    beam.set_speed_sp(150);
-    beam.run_forever();
-    while (beam.state().count("stalled") == 0)
+    _backend->reset(Backend::BEAM);
+    _backend->set_stop_action(Backend::BEAM, "hold");
+    _backend->set_speed_sp(Backend::BEAM, 150);
+    _backend->run_forever(Backend::BEAM);
+    while ((_backend->state(Backend::BEAM) & Backend::STALLED) == 0)
     {
-        chrono::milliseconds waitfor = chrono::milliseconds(10);
-        this_thread::sleep_for(waitfor);
+        _backend->sleep_for(chrono::milliseconds(10));
     }
-    beam.stop();
-    beam.set_position_sp(-35);
-    beam.run_to_rel_pos();
+    _backend->stop(Backend::BEAM);
+    _backend->set_position_sp(Backend::BEAM, mechanics::BEAM_HOME);
+    _backend->run_to_rel_pos(Backend::BEAM);
+    waitidle(Backend::BEAM); // motions are relative to the beam at rest
 
     // Init turntable
-    motor &turntable = g_motors[Actuators::TURNTABLE];
-    turntable.reset();
-    turntable.set_stop_action("hold");
-    turntable.set_speed_sp(500);
-    turntable.set_position_sp(-270);
+    _backend->reset(Backend::TURNTABLE);
+    _backend->set_stop_action(Backend::TURNTABLE, "hold");
+    _backend->set_speed_sp(Backend::TURNTABLE, 500);
+
+    // Init scanner, which rests clear of the cube
+    _backend->reset(Backend::SCANNER);
+    _backend->set_stop_action(Backend::SCANNER, "hold");
+    _backend->set_speed_sp(Backend::SCANNER, 1000);
+
+    for (int pos = 0; pos < 54; pos++)
+    {
+        _facelets[pos] = pos;
+    }
+
+    _planner_asleep = false;
+    _actuator_asleep = false;
+    _dispatched = 0;
+    _done = 0;
+    _dropping = false;
+    _failed = false;
+    _quit = false;
+    _actuator = thread(&Device::actuate, this);
 }
 
 Device::~Device()
 {
-    motor &beam = g_motors[Actuators::BEAM];
-    beam.reset();
+    _pending.clear();
+    _dropping = true;
+    try
+    {
+        wait_actuator();
+    }
+    catch (...) // the device is left as it is anyway
+    {
+    }
+    {
+        lock_guard<mutex> lock(_mutex);
+        _quit = true;
+        _progress.notify_all();
+    }
+    _actuator.join();
 
-    motor &turntable = g_motors[Actuators::TURNTABLE];
-    turntable.reset();
+    _color.stop();
+    _backend->reset(Backend::BEAM);
+    _backend->reset(Backend::TURNTABLE);
+    _backend->reset(Backend::SCANNER);
 }
 
 bool Device::valid() const
 {
-    return g_sensors[Sensors::BUTTON].connected() && g_sensors[Sensors::COLOR].connected() &&
-           g_sensors[Sensors::CUBE].connected() && g_motors[Actuators::BEAM].connected() &&
-           g_motors[Actuators::TURNTABLE].connected() && g_motors[Actuators::SCANNER].connected();
+    return _backend->connected(Backend::BUTTON) && _backend->connected(Backend::COLOR) &&
+           _backend->connected(Backend::CUBE) && _backend->connected(Backend::BEAM) &&
+           _backend->connected(Backend::TURNTABLE) && _backend->connected(Backend::SCANNER);
 }
 
 void Device::down(DeviceFace face)
@@ -127,11 +162,105 @@ void Device::down(DeviceFace face)
     }
 }
 
-void Device::scan() {}
+void Device::rotate(RubiksFace axis, int n)
+{
+    auto state = _state;
+    for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
+    {
+        auto to = (RubiksFace)(Rubiks::rotated(face + Rubiks::CC, axis, n) - Rubiks::CC);
+        _state[to] = state[face];
+    }
+
+    for (auto &facelet : _facelets)
+    {
+        facelet = Rubiks::rotated(facelet, axis, n);
+    }
+}
+
+void Device::scan(Readings &readings, int n)
+{
+    flush();
+
+    _backend->set_mode(Backend::COLOR, "RGB-RAW");
+    Sampling sampling(_color, Backend::TURNTABLE); // for the whole scan, along with where the table is for a sweep
+    _backend->set_speed_sp(Backend::TURNTABLE, 1000); // the table only carries the cube here, no need to go easy
+    _backend->set_position_sp(Backend::SCANNER, mechanics::SCANNER_CENTER);
+    _backend->run_to_rel_pos(Backend::SCANNER);
+    waitidle(Backend::SCANNER);
+    read(readings, Rubiks::UP + Rubiks::CC);
+
+    int ccw_quarters = (4 - normalized_turns(n)) % 4; // 0..3
+    int quarters = _scan_mode == SWEEP ? scan_sweep(readings, ccw_quarters) : scan_stepwise(readings, ccw_quarters);
+
+    _backend->set_speed_sp(Backend::TURNTABLE, 500);
+
+    reorient(Rubiks::DOWN, quarters);
+    for (int i = 0; i < abs(quarters); i++)
+    {
+        for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
+        {
+            _state[face] = quarters > 0 ? table_ccw_permutation[_state[face]] : table_cw_permutation[_state[face]];
+        }
+    }
+}
+
+void Device::rescan(Readings &readings, int pos)
+{
+    auto at = [this](int pos) { return (int)(find(_facelets.begin(), _facelets.end(), pos) - _facelets.begin()); };
+    if (at(pos) / 9 != Rubiks::UP / 9)
+        down((DeviceFace)(at(pos) / 9 ^ 1)); // its opposite face down
+    flush();
+
+    _backend->set_mode(Backend::COLOR, "RGB-RAW");
+    Sampling sampling(_color, Backend::TURNTABLE);
+    int cell = at(pos);
+    if (cell == Rubiks::UP + Rubiks::CC)
+    {
+        _backend->set_position_sp(Backend::SCANNER, mechanics::SCANNER_CENTER);
+        _backend->run_to_rel_pos(Backend::SCANNER);
+        waitidle(Backend::SCANNER);
+        read(readings, cell);
+        _backend->set_position_sp(Backend::SCANNER, -mechanics::SCANNER_CENTER);
+        _backend->run_to_rel_pos(Backend::SCANNER);
+        waitidle(Backend::SCANNER);
+        return;
+    }
+
+    // Turn the table the shortest way to have the cell under the sensor, and back again afterwards
+    int k = 0;
+    while (ring_cell(k) != cell)
+        k++;
+    int eighths = k <= 4 ? k : k - 8; // ccw
+    int const eighth = -mechanics::TABLE_QUARTER / 2;
+    int scanner = k % 2 == 0 ? mechanics::SCANNER_EDGE : mechanics::SCANNER_CORNER;
+
+    _backend->set_speed_sp(Backend::TURNTABLE, 1000);
+    _backend->set_position_sp(Backend::TURNTABLE, eighths * eighth);
+    _backend->run_to_rel_pos(Backend::TURNTABLE);
+    _backend->set_position_sp(Backend::SCANNER, scanner);
+    _backend->run_to_rel_pos(Backend::SCANNER);
+    waitidle(Backend::TURNTABLE);
+    waitidle(Backend::SCANNER);
+
+    // The model doesn't follow the table here, so store the reading at the facelet's position directly
+    auto sample = _color.settled(_backend->now(), SETTLE_SAMPLES);
+    readings[pos] = {(double)sample.values[0], (double)sample.values[1], (double)sample.values[2]};
+
+    _backend->set_position_sp(Backend::TURNTABLE, -eighths * eighth);
+    _backend->run_to_rel_pos(Backend::TURNTABLE);
+    _backend->set_position_sp(Backend::SCANNER, -scanner);
+    _backend->run_to_rel_pos(Backend::SCANNER);
+    waitidle(Backend::TURNTABLE);
+    waitidle(Backend::SCANNER);
+    _backend->set_speed_sp(Backend::TURNTABLE, 500);
+}
+
+void Device::set_scan_mode(ScanMode mode) { _scan_mode = mode; }
 
 void Device::flip()
 {
-    do_move_beam(true, true);
+    schedule({Motion::FLIP, 1, 1});
+    reorient(Rubiks::BACK, 1);
 
     for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
     {
@@ -141,88 +270,397 @@ void Device::flip()
 
 void Device::turn(int n, bool lock) { internal_turn(n, lock, true, false); }
 
-void Device::tell(std::string const &msg) { sound::speak(msg, true); }
+void Device::flush()
+{
+    dispatch();
+    wait_actuator();
+}
 
-void Device::internal_turn(int n, bool lock, bool apply_beam_perm, bool apply_table_perm)
+void Device::tell(std::string const &msg)
 {
-    if (lock)
-    {
-        do_move_beam(true, false);
-    }
+    flush();
+    _backend->speak(msg);
+}
 
-    n = n == -3 ? 1 : n == 3 ? -1 : n;
+void Device::internal_turn(int n, bool lock, bool apply_beam_perm, bool apply_table_perm)
+{
+    n = normalized_turns(n);
     bool ccw = n < 0;
-    do_turn_table(ccw, abs(n));
 
     if (lock)
     {
-        do_move_beam(false, true);
+        // Locking and releasing without turning the table is a flip, really
+        int quarters = apply_beam_perm ? 1 : 0;
+        schedule(n == 0 ? Motion{Motion::FLIP, 1, quarters} : Motion{Motion::TWIST, n, quarters});
 
         if (apply_beam_perm)
         {
+            reorient(Rubiks::BACK, 1);
             for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
             {
                 _state[face] = beam_permutation[_state[face]];
             }
         }
     }
-    else if (apply_table_perm)
+    else
     {
-        for (int i = 0; i < abs(n); i++)
+        schedule({Motion::TABLE, n, apply_table_perm ? -n : 0});
+
+        if (apply_table_perm)
         {
-            for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
+            reorient(Rubiks::DOWN, -n);
+            for (int i = 0; i < abs(n); i++)
+            {
+                for (auto face : {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP})
+                {
+                    _state[face] = ccw ? table_ccw_permutation[_state[face]] : table_cw_permutation[_state[face]];
+                }
+            }
+        }
+    }
+}
+
+void Device::schedule(Motion const &motion)
+{
+    // Hold back the last motion, so that it can still merge with the next one
+    if (!_pending.empty() && _pending.back().kind == motion.kind && motion.kind != Motion::TWIST)
+    {
+        auto &last = _pending.back();
+        last.n = motion.kind == Motion::TABLE ? normalized_turns(last.n + motion.n) : (last.n + motion.n) % 4;
+        last.quarters = (last.quarters + motion.quarters) % 4;
+        if (last.n == 0 && last.quarters == 0) // motions cancel out
+            _pending.pop_back();
+        return;
+    }
+
+    dispatch();
+
+    if (motion.n != 0 || motion.quarters != 0)
+        _pending.push_back(motion);
+}
+
+void Device::dispatch()
+{
+    auto it = _pending.begin();
+    for (; it != _pending.end(); ++it)
+    {
+        bool pushed = _motions.try_push(*it);
+        if (!pushed)
+        {
+            // The actuator is that far behind: sleep until it is done with a motion (or drops one, if cancelled)
+            unique_lock<mutex> lock(_mutex);
+            _planner_asleep = true;
+            atomic_thread_fence(memory_order_seq_cst); // see wake
+            _progress.wait(lock, [this, it, &pushed] { return cancelled() || (pushed = _motions.try_push(*it)); });
+            _planner_asleep = false;
+            if (!pushed)
+                break;
+        }
+        _dispatched++;
+        wake(_actuator_asleep);
+    }
+
+    // The motions dropped are the last ones the state took in, so they come out first
+    for (auto dropped = _pending.rbegin(); dropped.base() != it; ++dropped)
+        undo(*dropped);
+    _pending.clear();
+}
+
+void Device::wait_actuator()
+{
+    unique_lock<mutex> lock(_mutex);
+    if (_done != _dispatched)
+    {
+        _planner_asleep = true;
+        atomic_thread_fence(memory_order_seq_cst); // see wake
+        _progress.wait(lock, [this] { return _done == _dispatched; });
+        _planner_asleep = false;
+    }
+
+    for (auto dropped = _dropped.rbegin(); dropped != _dropped.rend(); ++dropped)
+        undo(*dropped);
+    _dropped.clear();
+
+    if (_failure)
+    {
+        auto failure = _failure;
+        _failure = nullptr;
+        _failed = false;
+        rethrow_exception(failure);
+    }
+}
+
+void Device::wake(atomic<bool> const &asleep)
+{
+    // Pairs with the fence of the side going to sleep, between its flag and its check of the queue or count: either
+    // it sees what this side did before, or this side sees its flag
+    atomic_thread_fence(memory_order_seq_cst);
+    if (asleep)
+    {
+        lock_guard<mutex> lock(_mutex); // it is waiting then, or still checking, under the lock
+        _progress.notify_all();
+    }
+}
+
+void Device::actuate()
+{
+    Motion motion;
+    for (;;)
+    {
+        bool popped = _motions.try_pop(motion);
+        if (!popped)
+        {
+            // Sleeps until there is a motion, or the device goes
+            unique_lock<mutex> lock(_mutex);
+            _actuator_asleep = true;
+            atomic_thread_fence(memory_order_seq_cst); // see wake
+            _progress.wait(lock, [this, &motion, &popped] { return _quit || (popped = _motions.try_pop(motion)); });
+            _actuator_asleep = false;
+            if (!popped)
+                return;
+        }
+
+        exception_ptr failure;
+        bool dropped = _dropping || cancelled() || _failed;
+        try
+        {
+            if (!dropped)
+                execute(motion);
+        }
+        catch (...)
+        {
+            failure = current_exception(); // the motions after it are dropped, until the planner learns
+        }
+
+        if (failure || dropped)
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (failure)
             {
-                _state[face] = ccw ? table_ccw_permutation[_state[face]] : table_cw_permutation[_state[face]];
+                _failure = failure;
+                _failed = true;
             }
+            if (dropped)
+                _dropped.push_back(motion);
+        }
+        _done++;
+        wake(_planner_asleep);
+    }
+}
+
+void Device::execute(Motion const &motion)
+{
+    switch (motion.kind)
+    {
+    case Motion::FLIP:
+        do_flip(motion.n);
+        break;
+
+    case Motion::TABLE:
+        do_turn_table(motion.n);
+        break;
+
+    case Motion::TWIST:
+        do_twist(motion.n);
+        break;
+    }
+}
+
+void Device::do_flip(int n)
+{
+    _backend->set_position_sp(Backend::BEAM, mechanics::BEAM_ENGAGE);
+    _backend->run_to_rel_pos(Backend::BEAM);
+    waitidle(Backend::BEAM);
+
+    for (int i = 0; i < n; i++)
+    {
+        _backend->set_position_sp(Backend::BEAM, mechanics::BEAM_PULL);
+        _backend->run_to_rel_pos(Backend::BEAM);
+        waitidle(Backend::BEAM);
+
+        if (i + 1 < n) // re-engage right away, instead of going back to rest first
+        {
+            _backend->set_position_sp(Backend::BEAM, -mechanics::BEAM_PULL);
+            _backend->run_to_rel_pos(Backend::BEAM);
+            waitidle(Backend::BEAM);
         }
     }
+
+    _backend->set_speed_sp(Backend::BEAM, 325);
+    _backend->set_position_sp(Backend::BEAM, -mechanics::BEAM_ENGAGE - mechanics::BEAM_PULL);
+    _backend->run_to_rel_pos(Backend::BEAM);
+    _backend->set_speed_sp(Backend::BEAM, 150);
+    waitidle(Backend::BEAM);
+
+    // A tad of stabilisation time, else the beam bumps onto the brick
+    _backend->sleep_for(chrono::milliseconds(1000));
 }
 
-void Device::do_move_beam(bool forward, bool backward)
+void Device::do_twist(int n)
 {
-    motor &beam = g_motors[Actuators::BEAM];
+    _backend->set_position_sp(Backend::BEAM, mechanics::BEAM_ENGAGE);
+    _backend->run_to_rel_pos(Backend::BEAM);
+    waitidle(Backend::BEAM);
+
+    do_turn_table(n);
+
+    _backend->set_speed_sp(Backend::BEAM, 325);
+    _backend->set_position_sp(Backend::BEAM, -mechanics::BEAM_ENGAGE);
+    _backend->run_to_rel_pos(Backend::BEAM);
+    _backend->set_speed_sp(Backend::BEAM, 150);
+    waitidle(Backend::BEAM);
+
+    // A tad of stabilisation time, else the beam bumps onto the brick
+    _backend->sleep_for(chrono::milliseconds(1000));
+}
+
+void Device::do_turn_table(int n)
+{
+    // One motor command for all quarter turns; negative is ccw
+    _backend->set_position_sp(Backend::TURNTABLE, n * mechanics::TABLE_QUARTER);
+    _backend->run_to_rel_pos(Backend::TURNTABLE);
+    waitidle(Backend::TURNTABLE);
+}
+
+int Device::scan_stepwise(Readings &readings, int ccw_quarters)
+{
+    // Reading around in 8 steps of 45 degrees leaves the table at 315 degrees, from where a quarter turn back costs
+    // no more than going on to a full turn. So scan in the direction that ends closest to the wanted quarters.
+    int dir = ccw_quarters == 1 ? -1 : 1;                             // ccw is positive
+    int end = ccw_quarters == 1 ? -3 : ccw_quarters == 3 ? 3 : 4 + ccw_quarters; // quarters turned in the end
+    int const eighth = -mechanics::TABLE_QUARTER / 2;                // ccw, in motor degrees
+
+    int scanner = mechanics::SCANNER_CENTER;
+    for (int i = 0; i < 8; i++)
+    {
+        if (i > 0)
+        {
+            _backend->set_position_sp(Backend::TURNTABLE, dir * eighth);
+            _backend->run_to_rel_pos(Backend::TURNTABLE);
+        }
+        int target = i % 2 == 0 ? mechanics::SCANNER_EDGE : mechanics::SCANNER_CORNER;
+        _backend->set_position_sp(Backend::SCANNER, target - scanner);
+        _backend->run_to_rel_pos(Backend::SCANNER);
+        scanner = target;
+        waitidle(Backend::TURNTABLE);
+        waitidle(Backend::SCANNER);
+
+        read(readings, ring_cell(dir * i));
+    }
+
+    // Back to a whole quarter, and the scanner out of the way of the beam
+    _backend->set_position_sp(Backend::TURNTABLE, (end * 2 - dir * 7) * eighth);
+    _backend->run_to_rel_pos(Backend::TURNTABLE);
+    _backend->set_position_sp(Backend::SCANNER, -scanner);
+    _backend->run_to_rel_pos(Backend::SCANNER);
+    waitidle(Backend::TURNTABLE);
+    waitidle(Backend::SCANNER);
+
+    return end;
+}
 
-    if (forward)
+int Device::scan_sweep(Readings &readings, int ccw_quarters)
+{
+    // One full turn reads all cells of the ring; an extra quarter either way is a little longer sweep
+    int const end_of[4] = {4, 5, 6, -5};
+    int end = end_of[ccw_quarters];
+
+    _backend->set_position_sp(Backend::SCANNER, mechanics::SCANNER_RING - mechanics::SCANNER_CENTER);
+    _backend->run_to_rel_pos(Backend::SCANNER);
+    waitidle(Backend::SCANNER);
+
+    // The samples taken while the table turns, each along with the table's position; the table is done when it is at
+    // its target, or hasn't moved for a while (it holds a few degrees off)
+    vector<Sample> samples;
+    uint64_t next = _color.count();
+    int start = _backend->position(Backend::TURNTABLE);
+    int target = start - end * mechanics::TABLE_QUARTER;
+    _backend->set_position_sp(Backend::TURNTABLE, target - start);
+    _backend->run_to_rel_pos(Backend::TURNTABLE);
+    for (size_t moved = 0;; this_thread::yield())
     {
-        beam.set_position_sp(-215);
-        beam.run_to_rel_pos();
-        waitidle(beam);
+        _color.read(next, samples); // should this fall behind, the cells missed are left to the classifier
+        if (samples.empty())
+            continue;
+
+        auto const &last = samples.back();
+        while (samples[moved].position != last.position)
+            moved++;
+        if (abs(last.position - target) <= 1 || last.time - samples[moved].time > chrono::milliseconds(100))
+            break;
     }
 
-    if (forward && backward)
+    _backend->set_position_sp(Backend::SCANNER, -mechanics::SCANNER_RING);
+    _backend->run_to_rel_pos(Backend::SCANNER); // out of the way of the beam
+    waitidle(Backend::SCANNER);
+
+    // Bin the samples that are close enough to a cell's center, and average them per cell
+    int const eighth = mechanics::TABLE_QUARTER / 2;
+    int const window = eighth * 12 / 45; // 12 degrees of the table either way
+    Rgb sums[8] = {};
+    int counts[8] = {};
+    for (auto const &sample : samples)
     {
-        beam.set_position_sp(60);
-        beam.run_to_rel_pos();
-        waitidle(beam);
+        int ccw = start - sample.position;
+        int k = (int)lround((double)ccw / eighth);
+        if (abs(ccw - k * eighth) >= window)
+            continue;
+
+        k = ((k % 8) + 8) % 8;
+        sums[k].r += sample.values[0];
+        sums[k].g += sample.values[1];
+        sums[k].b += sample.values[2];
+        counts[k]++;
     }
 
-    if (backward)
+    for (int k = 0; k < 8; k++)
     {
-        beam.set_speed_sp(325);
-        beam.set_position_sp((forward && backward) ? 155 : 215);
-        beam.run_to_rel_pos();
-        beam.set_speed_sp(150);
-        waitidle(beam);
+        auto &reading = readings[_facelets[ring_cell(k)]];
+        if (counts[k] == 0) // the table turned too fast; leave it to the classifier
+        {
+            reading = MISSING;
+            continue;
+        }
 
-        // A tad of stabilisation time, else the beam bumps onto the brick
-        chrono::milliseconds waitfor = chrono::milliseconds(1000);
-        this_thread::sleep_for(waitfor);
+        reading.r = sums[k].r / counts[k];
+        reading.g = sums[k].g / counts[k];
+        reading.b = sums[k].b / counts[k];
     }
+
+    return end;
 }
 
-void Device::do_turn_table(bool ccw_table, uint8_t n_table)
+void Device::reorient(RubiksFace axis, int n)
 {
-    motor &turntable = g_motors[Actuators::TURNTABLE];
-    int curr_pos_sp = turntable.position_sp();
+    // The physical cube rotates in device coordinates; the facelets move along with it
+    auto facelets = _facelets;
+    for (int pos = 0; pos < 54; pos++)
+    {
+        _facelets[Rubiks::rotated(pos, axis, n)] = facelets[pos];
+    }
+}
 
-    if ((ccw_table && curr_pos_sp > 0) || (!ccw_table && curr_pos_sp < 0))
+void Device::undo(Motion const &motion)
+{
+    // The state moved along with the cube about the beam's axis, or the table's
+    auto axis = motion.kind == Motion::TABLE ? Rubiks::DOWN : Rubiks::BACK;
+    reorient(axis, -motion.quarters);
+    for (auto &entry : _state)
     {
-        turntable.set_position_sp(-curr_pos_sp);
+        entry.second = (DeviceFace)(Rubiks::rotated(entry.second * 9 + Rubiks::CC, axis, -motion.quarters) / 9);
     }
+}
 
-    for (uint8_t i = 0; i < n_table; i++)
+void Device::read(Readings &readings, int pos)
+{
+    auto sample = _color.settled(_backend->now(), SETTLE_SAMPLES);
+    readings[_facelets[pos]] = {(double)sample.values[0], (double)sample.values[1], (double)sample.values[2]};
+}
+
+void Device::waitidle(Backend::Motor motor)
+{
+    while (_backend->state(motor) & Backend::RUNNING)
     {
-        turntable.run_to_rel_pos();
-        waitidle(turntable);
+        _backend->sleep_for(chrono::milliseconds(10));
     }
 }
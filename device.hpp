@@ -1,20 +1,49 @@
 #pragma once
 
+#include "backend.hpp"
+#include "classifier.hpp"
 #include "rubiks.hpp"
+#include "queue.hpp"
+#include "sampler.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 // Represents the LEGO EV3 cube crawler.
 //
 // The device maintains state how its faces are oriented. The device calls the face at the turntable 'down', the
 // face near the beam 'left', and the face near the cube sensor 'back'. Initially, that is, when placed, the cube
 // has the same orientation. But after one or more operations on the cube through the device the faces of the cube
-// will be permuted. How they are can be obtained using the query 'permutation()'.
+// will be permuted. How they are can be obtained using the query 'permutation()'. The orientation is tracked down
+// to single facelets as well, so that 'scan' knows which facelet of the cube model is under the color sensor.
+//
+// Commands only update the orientation state right away. The motions they imply are coalesced first: consecutive
+// table turns merge into a single motor command, consecutive flips are chained without returning the beam to its rest
+// position, and motions that net to zero are dropped. Use 'flush()' to have all pending motions executed.
+//
+// The motors are driven by an actuator thread of the device's own. The thread giving the commands only plans: it
+// updates the state and hands the coalesced motions over through a lock-free queue, so it runs ahead of the motors,
+// and working out the next motions never holds up the next motor command. Either thread sleeps while it waits for
+// the other: the actuator while there is nothing to do, the planner while the queue is full or draining. Scans, speech
+// and 'flush()' wait for the actuator to be done first. Once the cancellation flag given is set, motions are dropped
+// instead of executed (all but the one in progress), and 'flush()' takes them back out of the state, so that it
+// keeps telling how the cube really is.
 //
 class Device
 {
   public:
     enum Face : int { LEFT, RIGHT, BACK, FRONT, DOWN, UP };
+    enum ScanMode {
+        STEPWISE, // Stops the table for every cell
+        SWEEP     // Samples while the table turns a full turn at once
+    };
     using DeviceFace = Device::Face;
     using RubiksFace = Rubiks::Face;
 
@@ -22,8 +51,9 @@ class Device
         Construction & Destruction:
     */
 
-    // Constructs a cube-crawler device
-    explicit Device();
+    // Constructs a cube-crawler device on top of the given hardware (real or simulated), optionally cancelled by the
+    // given flag
+    explicit Device(std::shared_ptr<Backend> backend, std::atomic<bool> const *cancelled = nullptr);
 
     // Destructor leaves device resources nicely
     ~Device();
@@ -38,6 +68,9 @@ class Device
     // Map that tells at which DeviceFace a CubeFace is located
     auto permutation() const -> std::map<RubiksFace, DeviceFace> const &;
 
+    // Time on the device's clock (virtual when simulated)
+    auto now() const -> Backend::Duration;
+
     /*
         Commands:
     */
@@ -45,8 +78,19 @@ class Device
     // Bring the given device face to the turn table
     void down(DeviceFace face);
 
-    // Scan color of cube's face that is up
-    void scan();
+    // Rotate the cube model about axis n times; the physical cube stays put, only the permutation is updated
+    void rotate(RubiksFace axis, int n);
+
+    // Scan the raw colors of the face that is up into readings (at the cube model's positions), leaving the table
+    // turned n times ccw (<0) or cw (>0) afterwards; a single quarter turn either way comes (nearly) for free
+    void scan(Readings &readings, int n = 0);
+
+    // Read the raw color of a single facelet (a cube model position) into readings again; brings its face up first if
+    // need be, and leaves the table as it was
+    void rescan(Readings &readings, int pos);
+
+    // Choose how 'scan' reads the cells around the center (SWEEP by default)
+    void set_scan_mode(ScanMode mode);
 
     // Flip once, brings face at the color scanner's side up
     void flip();
@@ -54,14 +98,59 @@ class Device
     // Turn the table n times ccw (<0) or cw (>0) (opt: locking cube induces a flip at the end)
     void turn(int n, bool lock);
 
+    // Execute all motions that are still pending, and wait until they are done
+    void flush();
+
     // let cube-crawler speak a msg
     void tell(std::string const &msg);
 
   private:
+    struct Motion {
+        enum Kind { FLIP, TABLE, TWIST };
+        Kind kind;
+        int n;
+        int quarters; // the state was moved along by, about the beam's axis (BACK) or the table's (DOWN)
+    };
+
     void internal_turn(int n, bool lock, bool apply_beam_perm, bool apply_table_perm);
-    void do_move_beam(bool forward, bool backward);
-    void do_turn_table(bool ccw_table, uint8_t n_table);
+    void schedule(Motion const &motion);
+    bool cancelled() const { return _cancelled != nullptr && _cancelled->load(); }
+    void dispatch();
+    void wait_actuator();
+    void wake(std::atomic<bool> const &asleep); // the other side, if it sleeps
+    void actuate();
+    void execute(Motion const &motion);
+    void undo(Motion const &motion); // takes a motion dropped back out of the state
+    void do_flip(int n);
+    void do_twist(int n);
+    void do_turn_table(int n);
+    auto scan_stepwise(Readings &readings, int ccw_quarters) -> int;
+    auto scan_sweep(Readings &readings, int ccw_quarters) -> int;
+    void waitidle(Backend::Motor motor);
+    void reorient(RubiksFace axis, int n);
+    void read(Readings &readings, int pos);
+    std::shared_ptr<Backend> _backend;
+    std::atomic<bool> const *_cancelled;
+    Sampler _color; // runs while scanning
+    ScanMode _scan_mode;
     std::map<RubiksFace, DeviceFace> _state;
+    std::array<int, 54> _facelets; // cube model position of the facelet at each device position (face + cell)
+    std::vector<Motion> _pending;
+    SpscQueue<Motion, 64> _motions;     // to the actuator, lock-free
+    std::mutex _mutex;                  // only to sleep or wake a sleeper; guards _quit, _failure and _dropped
+    std::condition_variable _progress;  // a motion handed over or done, or _quit set
+    std::atomic<bool> _planner_asleep;  // on _progress
+    std::atomic<bool> _actuator_asleep; // on _progress
+    std::size_t _dispatched;            // motions handed to the actuator (by the planner only)
+    std::atomic<std::size_t> _done;     // motions the actuator is done with (executed or dropped)
+    std::atomic<bool> _dropping;        // actuator drops motions instead of executing them
+    std::atomic<bool> _failed;          // _failure is set
+    bool _quit;
+    std::exception_ptr _failure;  // of the actuator, set before _done counts the motion
+    std::vector<Motion> _dropped; // by the actuator, to undo
+    std::thread _actuator;
 };
 
 inline std::map<Device::RubiksFace, Device::DeviceFace> const &Device::permutation() const { return _state; }
+
+inline Backend::Duration Device::now() const { return _backend->now(); }
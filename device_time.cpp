@@ -0,0 +1,98 @@
+#include "device_time.hpp"
+#include "device.hpp"
+#include <chrono>
+#include <memory>
+
+using namespace std;
+
+namespace {
+
+constexpr int FACES = 6;
+constexpr int TURNS = 3; // 1, 2 and -1 quarter turns
+
+// Per device face and number of quarter turns: how long a turn of the face there takes, and where it takes the face at
+// each device face
+struct Turns {
+    array<array<double, TURNS>, FACES> seconds;
+    array<array<array<int, FACES>, TURNS>, FACES> moved;
+};
+
+int turn_index(int n) { return (n % 4 + 4) % 4 - 1; } // 1, 2, 3 (= -1) to 0, 1, 2
+
+// Turns a face as 'run' in worker.cpp does, on a simulated crawler, and times it on its virtual clock
+Turns const &turns()
+{
+    static auto const turns = [] {
+        Turns result;
+        Device crawler(make_shared<detail::SimBackend>());
+        for (int at = 0; at < FACES; at++)
+        {
+            for (int n : {1, 2, -1})
+            {
+                crawler.flush();
+                auto before = crawler.permutation();
+                auto start = crawler.now();
+                crawler.down((Device::Face)at);
+                crawler.turn(n * -1, true);
+                crawler.flush();
+
+                auto index = turn_index(n);
+                result.seconds[at][index] = chrono::duration<double>(crawler.now() - start).count();
+                for (auto const &entry : crawler.permutation())
+                    result.moved[at][index][before.at(entry.first)] = entry.second;
+            }
+        }
+        return result;
+    }();
+    return turns;
+}
+
+} // namespace
+
+DeviceTime::DeviceTime(Solver::Placement const &placement) : _seconds(0.0)
+{
+    for (int face = 0; face < FACES; face++)
+        _at[face] = face;
+    for (auto const &entry : placement)
+        _at[entry.first / 9] = entry.second;
+}
+
+double DeviceTime::of(vector<Solver::Step> const &steps, Solver::Placement const &placement)
+{
+    DeviceTime time(placement);
+    for (auto const &step : steps)
+        time.run(step);
+    return time.seconds();
+}
+
+double DeviceTime::cost(Rubiks::Face face, int n) const
+{
+    auto index = turn_index(n);
+    return index < 0 ? 0.0 : turns().seconds[_at[face / 9]][index];
+}
+
+void DeviceTime::run(Solver::Step const &step)
+{
+    Solver::Operation op;
+    Rubiks::Face face;
+    int n;
+    tie(op, face, n) = step;
+
+    auto at = _at;
+    if (op == Solver::Rotate) // as Device::rotate
+    {
+        for (int from = 0; from < FACES; from++)
+            _at[(Rubiks::rotated(from * 9 + Rubiks::CC, face, n) - Rubiks::CC) / 9] = at[from];
+        return;
+    }
+
+    auto index = turn_index(n);
+    if (index < 0)
+        return;
+
+    auto const &turn = turns();
+    auto const &moved = turn.moved[at[face / 9]][index];
+    _seconds += turn.seconds[at[face / 9]][index];
+    for (int other = 0; other < FACES; other++)
+        _at[other] = moved[at[other]];
+}
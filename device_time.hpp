@@ -0,0 +1,47 @@
+#pragma once
+
+#include "rubiks.hpp"
+#include "solver.hpp"
+#include <array>
+#include <vector>
+
+// Estimates how long the crawler takes to run steps, without running them
+//
+// What a turn takes depends on where its face is on the crawler: the face on the turntable is twisted right away, any
+// other is brought there first (see Device::down), by flips and table turns that take about as long as the twist
+// itself. So the estimate follows the faces around as the device does. How long each turn takes, and where it leaves
+// the faces, is found by running it on a simulated device, once. Rotations only reorient the model, for free.
+//
+class DeviceTime
+{
+  public:
+    // Starts out with the cube's faces at the given device faces (where the cube model has them if none given)
+    explicit DeviceTime(Solver::Placement const &placement = Solver::Placement());
+
+    // Seconds the crawler takes to run the steps
+    static auto of(std::vector<Solver::Step> const &steps, Solver::Placement const &placement = Solver::Placement())
+        -> double;
+
+    /*
+        Queries:
+    */
+
+    // Seconds the steps run so far take
+    auto seconds() const -> double { return _seconds; }
+
+    // Seconds a turn of the face takes next (n quarter turns, ccw < 0)
+    auto cost(Rubiks::Face face, int n) const -> double;
+
+    // The device face (a Device::Face) the face is at
+    auto at(Rubiks::Face face) const -> int { return _at[face / 9]; }
+
+    /*
+        Commands:
+    */
+
+    void run(Solver::Step const &step);
+
+  private:
+    std::array<int, 6> _at; // by face / 9
+    double _seconds;
+};
@@ -1,12 +1,30 @@
+#include "backend.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
 #include "device.hpp"
+#include "device_time.hpp"
+#include "orient.hpp"
+#include "pool.hpp"
+#include "remote.hpp"
 #include "rubiks.hpp"
+#include "service.hpp"
 #include "solver.hpp"
+#include "states.hpp"
+#include "sysfs.hpp"
+#include "trace.hpp"
 #include "worker.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <sstream>
 
 using namespace std;
 
@@ -14,7 +32,7 @@ using namespace std;
 
 namespace {
 
-volatile bool _interrupted = false;
+atomic<bool> _interrupted(false); // set by the signal handler, read by the planning and actuator threads
 bool interrupted() { return _interrupted; };
 
 void sigint_ignore(int /*s*/)
@@ -63,9 +81,89 @@ int run_pc()
     return 0;
 }
 
-int run_brick()
+// The options of brick and sim
+struct CrawlOptions {
+    char const *record_path = nullptr;
+    char const *remote_address = nullptr;
+    char const *cache_path = nullptr;
+    Solver::Scramble scramble = Solver::RANDOM_STATE; // fair, and in about 20 turns of which many half turns
+    size_t orientations = 1; // to solve in, keeping the fastest solution on the crawler
+};
+
+// The solver for a crawler: on the server at the remote address, if any; solving in several orientations, or
+// through the cache, if asked. Not both: the orientation picked depends on the crawler's placement, which the cache
+// doesn't key on.
+shared_ptr<Solver> solver_for(CrawlOptions const &options)
 {
-    Device crawler;
+    shared_ptr<Solver> solver;
+    if (options.remote_address != nullptr)
+        solver = make_shared<detail::RemoteSolver>(options.remote_address);
+    else
+        solver = Solver::Create(Solver::L123);
+    if (options.orientations > 1)
+    {
+        solver =
+            make_shared<detail::OrientingSolver>(solver, options.orientations, detail::OrientingSolver::DEVICE_SECONDS);
+        if (options.cache_path != nullptr)
+            cout << "not caching solutions: they are picked for the crawler's placement with --orientations\n";
+    }
+    else if (options.cache_path != nullptr)
+        solver = make_shared<detail::CachingSolver>(solver, make_shared<SolutionCache>(options.cache_path));
+    solver->set_scramble(options.scramble);
+    return solver;
+}
+
+// Scans the cube on the crawler, scrambles it if it is solved, then solves it; cube models the cube on the device.
+// The scan and the steps go into the trace when the session is recorded.
+void crawl(Device &crawler, Rubiks &cube, Solver &solver, detail::RecordingBackend *recorder = nullptr)
+{
+    crawler.tell("scanning!");
+
+    if (recorder != nullptr)
+        recorder->scan();
+    scan(cube, crawler, interrupted);
+
+    if (cube.solved() && !interrupted())
+    {
+        crawler.tell("scrambling!");
+
+        Solver::Placement placement(crawler.permutation().begin(), crawler.permutation().end());
+        solver.set_placement(placement);
+        auto problem = solver.scramble(cube);
+        cout << "scramble of " << problem.size() << " turns, about " << DeviceTime::of(problem, placement)
+             << " s on the crawler\n";
+        solver.set_history(problem); // solved by undoing it, unless the cube gets disturbed
+        if (recorder != nullptr)
+            recorder->steps(problem);
+        run(problem, crawler, interrupted);
+    }
+
+    crawler.tell("solving!");
+
+    if (!interrupted())
+    {
+        solver.set_placement(Solver::Placement(crawler.permutation().begin(), crawler.permutation().end()));
+
+        // The crawler starts on the first stage of the solution while the solver works on the rest
+        Solver::Emit record;
+        if (recorder != nullptr)
+            record = [recorder](vector<Solver::Step> const &steps) { recorder->steps(steps); };
+        solve(solver, cube, crawler, interrupted, record);
+    }
+
+    crawler.tell("cube solved!");
+}
+
+int run_brick(CrawlOptions const &options)
+{
+    auto solver = solver_for(options);
+
+    auto backend = Backend::Create(Backend::EV3);
+    shared_ptr<detail::RecordingBackend> recorder;
+    if (options.record_path != nullptr)
+        backend = recorder = make_shared<detail::RecordingBackend>(backend, options.record_path);
+
+    Device crawler(backend, &_interrupted);
 
     if (!crawler.valid())
         throw runtime_error("LEGO Cube-Crawler not valid");
@@ -73,39 +171,230 @@ int run_brick()
     crawler.tell("cube detected!");
 
     Rubiks cube;
-    auto solver = Solver::Create(Solver::L123);
+    crawl(crawler, cube, *solver, recorder.get());
+
+    return 0;
+}
+
+int run_sim(CrawlOptions const &options)
+{
+    auto solver = solver_for(options);
 
-    crawler.tell("scrambling!");
+    // Start out with a scrambled cube on the crawler
+    Rubiks scrambled;
+    solver->scramble(scrambled);
 
-    if (!interrupted())
+    auto sim = make_shared<detail::SimBackend>(scrambled);
+    shared_ptr<Backend> backend = sim;
+    shared_ptr<detail::RecordingBackend> recorder;
+    if (options.record_path != nullptr)
+        backend = recorder = make_shared<detail::RecordingBackend>(sim, options.record_path);
+
+    auto start = chrono::steady_clock::now();
+
+    Rubiks cube;
+    bool in_sync = true;
     {
-        auto problem = solver->scramble(cube);
-        run(problem, crawler, interrupted);
+        Device crawler(backend, &_interrupted);
+        crawl(crawler, cube, *solver, recorder.get());
+
+        // The virtual cube (in device coordinates) should match the model through the device's permutation
+        auto virtual_cube = sim->cube();
+        for (auto const &entry : crawler.permutation())
+        {
+            auto device_face = (Rubiks::Face)(entry.second * 9);
+            in_sync = in_sync && virtual_cube.color(device_face, Rubiks::CC) == cube.color(entry.first, Rubiks::CC);
+        }
+        // Once interrupted, the model is as far as the solver got rather than the crawler: only the faces compare
+        if (!interrupted())
+            in_sync = in_sync && virtual_cube.solved() == cube.solved();
     }
 
-    crawler.tell("solving!");
+    auto real_time = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    auto sim_time = chrono::duration_cast<chrono::milliseconds>(sim->now());
+    auto stats = sim->stats();
 
-    if (!interrupted())
+    cout << "simulated wall time: " << sim_time.count() / 1000.0 << " s (in " << real_time.count() << " ms)\n";
+    cout << "motor commands: " << stats.commands << ", attribute accesses: " << stats.accesses << "\n";
+    cout << "flips: " << stats.flips << ", quarter turns: " << stats.quarter_turns << ", faults: " << stats.faults
+         << "\n";
+    cout << "virtual cube in sync with model: " << (in_sync ? "yes" : "NO") << "\n";
+
+    return in_sync && stats.faults == 0 ? 0 : 1;
+}
+
+// Runs the steps of a recorded session against its trace, on a virtual clock
+int run_replay(char const *path)
+{
+    auto replay = make_shared<detail::ReplayBackend>(path);
+    auto start = chrono::steady_clock::now();
     {
-        auto solution = solver->solve(cube);
-        run(solution, crawler, interrupted);
+        Device crawler(replay, &_interrupted);
+
+        Rubiks cube;
+        while (auto record = replay->next())
+        {
+            if (interrupted())
+                break;
+
+            if (record->op == trace::SPEAK)
+                crawler.tell(record->payload);
+            else if (record->op == trace::SCAN)
+                scan(cube, crawler, interrupted);
+            else
+                run(trace::unpack(record->payload), crawler, interrupted);
+        }
     }
 
-    crawler.tell("cube solved!");
+    auto real_time = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    auto replayed = chrono::duration_cast<chrono::milliseconds>(replay->now());
+    auto recorded = chrono::duration_cast<chrono::milliseconds>(replay->recorded());
+
+    cout << "recorded wall time: " << recorded.count() / 1000.0 << " s\n";
+    cout << "replayed wall time: " << replayed.count() / 1000.0 << " s (in " << real_time.count() << " ms)\n";
 
-    /*
-    Rubiks cube;
-    auto solver = Solver::Create(Solver::L123);
-    scan(cube, crawler);
-    auto solution = solver->solve(cube);
-    run(solution, crawler);
-    */
     return 0;
 }
 
+int run_bench_io(char const *fake_dir)
+{
+    string class_dir = sysfs::CLASS_DIR;
+
+    if (fake_dir != nullptr)
+    {
+        class_dir = fake_dir;
+        sysfs::fake(class_dir);
+    }
+
+    sysfs::benchmark(class_dir, 10000, cout);
+
+    return 0;
+}
+
+// Solves the cubes on the lines of stdin, see SolveService
+int run_serve_stdin()
+{
+    ios::sync_with_stdio(false); // for in_avail to see what is buffered
+    cin.tie(nullptr);
+
+    SolveService service;
+    service.serve({[](string &line) { return (bool)getline(cin, line); },
+                   [] { return cin.rdbuf()->in_avail() > 0; },
+                   [](string const &lines) { cout << lines << flush; }},
+                  interrupted);
+
+    auto stats = service.stats();
+    cerr << "solved " << stats.solved << " of " << stats.requests << " cubes on " << service.workers()
+         << " workers, latency mean " << (uint64_t)stats.mean << " us, p99 " << (uint64_t)stats.p99 << " us\n";
+
+    return stats.failed == 0 ? 0 : 1;
+}
+
+// Solves the states in a file on all cores, and reports on the run
+int run_batch(batch::Options const &options)
+{
+    auto summary = batch::run(options, interrupted);
+
+    // In plain numbers (not 1.5e+06), the mean to as many decimals as given
+    auto spread = [](batch::Spread const &s, int decimals) {
+        ostringstream os;
+        os << fixed << setprecision(decimals) << "mean " << s.mean << ", p50 " << (uint64_t)s.p50 << ", p90 "
+           << (uint64_t)s.p90 << ", p99 " << (uint64_t)s.p99 << ", max " << (uint64_t)s.max;
+        return os.str();
+    };
+    cout << summary.states << " states in " << summary.seconds << " s on " << options.threads << " threads: "
+         << (uint64_t)(summary.states / max(summary.seconds, 1e-9)) << " states/s\n";
+    cout << "solved: " << summary.solved << ", rejected: " << summary.rejected << ", failed: " << summary.failed
+         << "\n";
+    if (!options.cache.empty())
+        cout << "from the cache: " << summary.cached << "\n";
+    cout << "latency (us): " << spread(summary.latency, 0) << "\n";
+    cout << "moves: " << spread(summary.moves, 2) << "\n";
+
+    return summary.failed == 0 ? 0 : 1;
+}
+
+// Checks the states in a text or binary file, and reports what was rejected why
+int run_check(char const *path)
+{
+    auto start = chrono::steady_clock::now();
+    StateFile states(path);
+    auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    map<StateFile::Reason, size_t> rejected;
+    for (size_t row = 0; row < states.size(); row++)
+        if (states.rejected(row))
+            rejected[states.reason(row)]++;
+
+    cout << states.size() << " states in " << seconds << " s: " << (uint64_t)(states.size() / max(seconds, 1e-9))
+         << " states/s\n";
+    cout << "accepted: " << states.accepted() << "\n";
+    for (auto const &entry : rejected)
+        cout << "rejected, " << StateFile::describe(entry.first) << ": " << entry.second << "\n";
+
+    return 0;
+}
+
+// The number of orientations to solve in, 1, 6 or 24; 0 if none of these
+size_t orientations_of(char const *arg)
+{
+    auto n = strtoul(arg, nullptr, 10);
+    return n == 1 || n == 6 || n == 24 ? n : 0;
+}
+
+// Parses the options of batch
+bool batch_options(int argc, char *argv[], batch::Options &options)
+{
+    options.threads = WorkerPool::default_workers();
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--in") == 0)
+            options.in = argv[i + 1];
+        else if (strcmp(argv[i], "--out") == 0)
+            options.out = argv[i + 1];
+        else if (strcmp(argv[i], "--threads") == 0)
+            options.threads = strtoul(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "--strategy") == 0)
+            options.strategy = batch::parse_strategy(argv[i + 1]);
+        else if (strcmp(argv[i], "--cache") == 0)
+            options.cache = argv[i + 1];
+        else if (strcmp(argv[i], "--orientations") == 0 && orientations_of(argv[i + 1]) > 0)
+            options.orientations = orientations_of(argv[i + 1]);
+        else
+            return false;
+    }
+    return argc % 2 == 0 && !options.in.empty() && !options.out.empty() && options.threads > 0;
+}
+
+// Parses the options of brick and sim
+bool crawl_options(int argc, char *argv[], CrawlOptions &options)
+{
+    static map<string, Solver::Scramble> const scrambles = {
+        {"moves", Solver::RANDOM_MOVES}, {"state", Solver::RANDOM_STATE}, {"fast", Solver::DEVICE_TIME}};
+
+    for (int i = 2; i < argc; i += 2)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--record") == 0)
+            options.record_path = argv[i + 1];
+        else if (i + 1 < argc && strcmp(argv[i], "--remote") == 0)
+            options.remote_address = argv[i + 1];
+        else if (i + 1 < argc && strcmp(argv[i], "--scramble") == 0 && scrambles.count(argv[i + 1]) > 0)
+            options.scramble = scrambles.at(argv[i + 1]);
+        else if (i + 1 < argc && strcmp(argv[i], "--cache") == 0)
+            options.cache_path = argv[i + 1];
+        else if (i + 1 < argc && strcmp(argv[i], "--orientations") == 0 && orientations_of(argv[i + 1]) > 0)
+            options.orientations = orientations_of(argv[i + 1]);
+        else
+            return false;
+    }
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     int retcode = 0;
+    CrawlOptions crawl_opts;
+    batch::Options batch_opts;
 
     signal(SIGINT, sigint_graciously);
 
@@ -115,13 +404,51 @@ int main(int argc, char *argv[])
         {
             retcode = run_pc();
         }
-        else if (argc == 2 && strcmp(argv[1], "brick") == 0)
+        else if (argc >= 2 && (strcmp(argv[1], "brick") == 0 || strcmp(argv[1], "sim") == 0) &&
+                 crawl_options(argc, argv, crawl_opts))
+        {
+            if (strcmp(argv[1], "brick") == 0)
+                retcode = run_brick(crawl_opts);
+            else
+                retcode = run_sim(crawl_opts);
+        }
+        else if (argc >= 2 && strcmp(argv[1], "batch") == 0 && batch_options(argc, argv, batch_opts))
+        {
+            retcode = run_batch(batch_opts);
+        }
+        else if (argc == 3 && strcmp(argv[1], "check") == 0)
+        {
+            retcode = run_check(argv[2]);
+        }
+        else if (argc == 3 && strcmp(argv[1], "serve") == 0 && strcmp(argv[2], "--stdin") == 0)
+        {
+            retcode = run_serve_stdin();
+        }
+        else if ((argc == 2 || argc == 3) && strcmp(argv[1], "serve") == 0)
+        {
+            remote::serve(argc == 3 ? argv[2] : remote::DEFAULT_ADDRESS, interrupted);
+        }
+        else if (argc == 3 && strcmp(argv[1], "replay") == 0)
+        {
+            retcode = run_replay(argv[2]);
+        }
+        else if (argc == 2 && strcmp(argv[1], "bench-io") == 0)
+        {
+            retcode = run_bench_io(nullptr);
+        }
+        else if (argc == 4 && strcmp(argv[1], "bench-io") == 0 && strcmp(argv[2], "--fake") == 0)
         {
-            retcode = run_brick();
+            retcode = run_bench_io(argv[3]);
         }
         else
         {
-            cout << "USAGE: cube-crawler [pc|brick]\n";
+            cout << "USAGE: cube-crawler [pc|brick [OPTIONS]|sim [OPTIONS]|serve [ADDRESS|--stdin]|batch BATCH|"
+                    "check FILE|replay FILE|bench-io [--fake DIR]]\n"
+                 << "OPTIONS: --record FILE, --remote ADDRESS, --scramble moves|state|fast, --cache FILE,\n"
+                 << "         --orientations 1|6|24\n"
+                 << "BATCH: --in FILE --out FILE [--threads N] [--strategy l123|cfop|twophase|portfolio]\n"
+                 << "       [--cache FILE] [--orientations 1|6|24]\n"
+                 << "ADDRESS: HOST:PORT, or the path of a Unix socket\n";
         }
     }
     catch (exception const &e)
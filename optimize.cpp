@@ -0,0 +1,163 @@
+#include "optimize.hpp"
+#include "cubie.hpp"
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+constexpr int MOVES = 18; // a move is face * 3 + (quarter turn, half turn, quarter turn back)
+constexpr int TURNS[] = {1, 2, -1};
+constexpr int NO_MOVE = -1;
+
+// Express n quarter turns as -1, 1 or 2 (0 if the turns cancel out)
+int normalized(int n)
+{
+    n = n % 4;
+    n = n < 0 ? n + 4 : n;
+    return n == 3 ? -1 : n;
+}
+
+Rubiks::Face face_of(int move) { return (Rubiks::Face)(move / 3 * 9); }
+
+// Whether the move is redundant after the last one: the same face again, or the opposite face in the other order
+bool redundant(int move, int last)
+{
+    if (last == NO_MOVE)
+        return false;
+    int face = move / 3, last_face = last / 3;
+    return face == last_face || (face / 2 == last_face / 2 && face < last_face);
+}
+
+struct Shortest {
+    uint8_t length;
+    array<uint8_t, optimize::WINDOW_TABLE> moves;
+};
+
+// The shortest moves to each state within WINDOW_TABLE moves of solved, breadth-first
+unordered_map<Cubies::Key, Shortest, Cubies::Key::Hash> const &table()
+{
+    static auto const table = [] {
+        unordered_map<Cubies::Key, Shortest, Cubies::Key::Hash> result;
+        vector<pair<Cubies, Shortest>> frontier = {{Cubies(), Shortest{0, {}}}};
+        result[Cubies().key()] = frontier.back().second;
+        for (int depth = 0; depth < optimize::WINDOW_TABLE; depth++)
+        {
+            vector<pair<Cubies, Shortest>> next;
+            for (auto const &entry : frontier)
+            {
+                int last = depth == 0 ? NO_MOVE : entry.second.moves[depth - 1];
+                for (int m = 0; m < MOVES; m++)
+                {
+                    if (redundant(m, last))
+                        continue;
+                    auto state = entry.first * Cubies::turn(face_of(m), TURNS[m % 3]);
+                    auto key = state.key();
+                    if (result.count(key) > 0)
+                        continue;
+                    auto shortest = entry.second;
+                    shortest.moves[shortest.length++] = (uint8_t)m;
+                    result[key] = shortest;
+                    next.emplace_back(state, shortest);
+                }
+            }
+            frontier.swap(next);
+        }
+        return result;
+    }();
+    return table;
+}
+
+// Adds the step to steps, merging it into the last one it cancels with, if any
+void push(vector<Solver::Step> &steps, Solver::Step const &step)
+{
+    Solver::Operation op;
+    Rubiks::Face face;
+    int n;
+    tie(op, face, n) = step;
+    n = normalized(n);
+    if (n == 0)
+        return;
+
+    auto is = [&steps, op](size_t i, Rubiks::Face f) { return get<0>(steps[i]) == op && get<1>(steps[i]) == f; };
+    size_t k = steps.size(), at = k;
+    if (k >= 1 && is(k - 1, face))
+        at = k - 1;
+    else if (op == Solver::Turn && k >= 2 && is(k - 1, opposite_of(face)) && is(k - 2, face))
+        at = k - 2;
+
+    if (at == k)
+    {
+        steps.push_back(make_tuple(op, face, n));
+        return;
+    }
+    auto merged = normalized(get<2>(steps[at]) + n);
+    if (merged == 0)
+        steps.erase(steps.begin() + at);
+    else
+        get<2>(steps[at]) = merged;
+}
+
+vector<Solver::Step> cancelled(vector<Solver::Step> const &steps)
+{
+    vector<Solver::Step> result;
+    for (auto const &step : steps)
+        push(result, step);
+    return result;
+}
+
+// Replaces the first window of turns that the table knows a shorter way for; returns false if there is none
+bool rewrite(vector<Solver::Step> &steps)
+{
+    auto const &shortest = table();
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        Cubies state;
+        for (size_t j = i; j < steps.size() && j < i + optimize::MAX_WINDOW; j++)
+        {
+            if (get<0>(steps[j]) != Solver::Turn)
+                break;
+            state = state * Cubies::turn(get<1>(steps[j]), get<2>(steps[j]));
+
+            auto found = shortest.find(state.key());
+            if (found == shortest.end() || found->second.length >= j - i + 1)
+                continue;
+
+            vector<Solver::Step> moves;
+            for (size_t k = 0; k < found->second.length; k++)
+            {
+                int m = found->second.moves[k];
+                moves.push_back(make_tuple(Solver::Turn, face_of(m), TURNS[m % 3]));
+            }
+            // The table's moves take solved to the state; the window takes solved there too
+            steps.erase(steps.begin() + i, steps.begin() + j + 1);
+            steps.insert(steps.begin() + i, moves.begin(), moves.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+namespace optimize {
+
+vector<Solver::Step> inverse(vector<Solver::Step> const &steps)
+{
+    vector<Solver::Step> result;
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it)
+        result.push_back(make_tuple(get<0>(*it), get<1>(*it), normalized(-get<2>(*it))));
+    return result;
+}
+
+vector<Solver::Step> shortened(vector<Solver::Step> const &steps)
+{
+    auto result = cancelled(steps);
+    while (rewrite(result))
+        result = cancelled(result);
+    return result;
+}
+
+} // namespace optimize
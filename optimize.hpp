@@ -0,0 +1,25 @@
+#pragma once
+
+#include "solver.hpp"
+#include <vector>
+
+// Shorter sequences of steps that do the same
+//
+// First, turns cancel: a turn merges into the last turn of the same face, also past turns of the opposite face in
+// between (which commute with it), and so do rotations about the same axis. Then windows of turns are rewritten: a
+// table holds the shortest turns to every state within WINDOW_TABLE turns of solved, and a window of turns that takes
+// the cube to such a state in more turns is replaced by the table's. Both repeat until nothing changes. Rotations are
+// kept where they are; windows don't span them. The table is built on first use, in a few milliseconds.
+//
+namespace optimize {
+
+constexpr int WINDOW_TABLE = 4; // depth of the table of shortest turns
+constexpr int MAX_WINDOW = 12;  // turns in a window, at most
+
+// The steps that undo the steps: backwards, each the other way
+auto inverse(std::vector<Solver::Step> const &steps) -> std::vector<Solver::Step>;
+
+// The steps, shortened as above; turns come out as 1, 2 or -1 quarter turns
+auto shortened(std::vector<Solver::Step> const &steps) -> std::vector<Solver::Step>;
+
+} // namespace optimize
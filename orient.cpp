@@ -0,0 +1,153 @@
+#include "orient.hpp"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+constexpr int FACES = 6;
+
+struct Candidate {
+    vector<Solver::Step> steps;
+    double measure;
+    exception_ptr error;
+};
+
+// The steps as turns only, of the faces as named before the first step
+vector<Solver::Step> flattened(vector<Solver::Step> const &steps)
+{
+    array<Rubiks::Face, FACES> named; // as at first, by the face's name now / 9
+    for (int face = 0; face < FACES; face++)
+        named[face] = (Rubiks::Face)(face * 9);
+
+    vector<Solver::Step> result;
+    for (auto const &step : steps)
+    {
+        Solver::Operation op;
+        Rubiks::Face face;
+        int n;
+        tie(op, face, n) = step;
+
+        if (op == Solver::Turn)
+        {
+            result.push_back(make_tuple(Solver::Turn, named[face / 9], n));
+            continue;
+        }
+        auto was = named;
+        for (int from = 0; from < FACES; from++)
+            named[(Rubiks::rotated(from * 9 + Rubiks::CC, face, n) - Rubiks::CC) / 9] = was[from];
+    }
+    return result;
+}
+
+} // namespace
+
+namespace detail {
+
+uint32_t OrientingSolver::config_id() const
+{
+    return _solver->config_id() | (uint32_t)_orientations.size() << 8 | (uint32_t)_measure << 16;
+}
+
+OrientingSolver::OrientingSolver(shared_ptr<Solver> solver, size_t orientations, Measure measure, size_t threads)
+    : _solver(solver), _measure(measure)
+{
+    if (orientations != 6 && orientations != 24)
+        throw invalid_argument("orienting solver: 6 or 24 orientations, not " + to_string(orientations));
+
+    set<int> down; // the faces brought DOWN so far
+    for (auto const &orientation : ::orientations())
+    {
+        int face = 0;
+        while (orientation.to[face] != Rubiks::DOWN)
+            face++;
+        if (orientations == 24 || down.insert(face).second)
+            _orientations.push_back(&orientation);
+    }
+
+    if (threads > 1)
+        _pool.reset(new WorkerPool(min(threads, _orientations.size())));
+}
+
+void OrientingSolver::set_log(ostream &os)
+{
+    BaseSolver::set_log(os);
+    _solver->set_log(os);
+}
+
+void OrientingSolver::set_placement(Placement const &placement)
+{
+    BaseSolver::set_placement(placement);
+    _solver->set_placement(placement);
+}
+
+void OrientingSolver::set_cancel(atomic<bool> const *cancel)
+{
+    BaseSolver::set_cancel(cancel);
+    _solver->set_cancel(cancel);
+}
+
+void OrientingSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
+{
+    vector<Candidate> candidates(_orientations.size());
+    auto attempt = [&](size_t i) {
+        auto &candidate = candidates[i];
+        try
+        {
+            auto turned = cube;
+            auto steps = _orientations[i]->rotations;
+            apply(steps, turned);
+            _solver->solve(turned, [&steps](vector<Step> const &stage) {
+                steps.insert(steps.end(), stage.begin(), stage.end());
+            });
+            candidate.steps = flattened(steps);
+            candidate.measure = cost(candidate.steps, _measure);
+        }
+        catch (...)
+        {
+            candidate.error = current_exception();
+        }
+    };
+
+    if (_pool == nullptr)
+    {
+        for (size_t i = 0; i < candidates.size(); i++)
+            attempt(i);
+    }
+    else
+    {
+        mutex mutex;
+        condition_variable done;
+        auto remaining = candidates.size();
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            _pool->submit([&, i](size_t) {
+                attempt(i);
+                lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0)
+                    done.notify_all();
+            });
+        }
+        unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&remaining] { return remaining == 0; });
+    }
+
+    // The best of those that solved, the first orientation on a tie
+    Candidate const *best = nullptr;
+    for (auto const &candidate : candidates)
+        if (!candidate.error && (best == nullptr || candidate.measure < best->measure))
+            best = &candidate;
+    if (best == nullptr)
+        rethrow_exception(candidates.front().error);
+
+    log() << "best of " << candidates.size() << " orientations: " << best->steps.size() << " turns\n";
+    apply(best->steps, cube);
+    emit(best->steps);
+}
+
+} // namespace detail
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pool.hpp"
+#include "solver.hpp"
+#include <cstddef>
+#include <memory>
+
+namespace detail {
+
+// Solves the cube in several orientations, and keeps the best solution
+//
+// A solver such as L123 builds the cross at whatever face is DOWN, so how long its solution is depends a lot on how
+// the cube happens to be held. This one has it solve the cube in 6 orientations (one with each face DOWN, so one per
+// cross color) or in all 24, in parallel on a pool of its own, and keeps the solution with the fewest turns, or that
+// the crawler runs fastest (as DeviceTime estimates, from the placement). The reorientation is folded into the
+// solution: rotations only rename the faces after them, so the solution comes out as turns of the faces as named at
+// first, and needs no rotations at all. It is emitted at once, when all orientations are done.
+//
+class OrientingSolver final : public BaseSolver
+{
+  public:
+    // Tries 6 or 24 orientations; on as many threads as given, or on the calling thread for 1
+    OrientingSolver(std::shared_ptr<Solver> solver, std::size_t orientations, Measure measure,
+                    std::size_t threads = WorkerPool::default_workers());
+    virtual ~OrientingSolver() = default;
+
+    auto strategy() const -> Strategy override { return _solver->strategy(); };
+    auto config_id() const -> std::uint32_t override;
+
+    // Also passed on to the solver
+    void set_log(std::ostream &os) override;
+    void set_placement(Placement const &placement) override;
+    void set_cancel(std::atomic<bool> const *cancel) override;
+
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
+
+  private:
+    std::shared_ptr<Solver> _solver;
+    std::vector<Orientation const *> _orientations;
+    Measure _measure;
+    std::unique_ptr<WorkerPool> _pool; // none for 1 thread
+};
+
+} // namespace detail
@@ -0,0 +1,30 @@
+#include "pool.hpp"
+
+using namespace std;
+
+WorkerPool::WorkerPool(size_t workers, size_t capacity) : _tasks(capacity)
+{
+    for (size_t worker = 0; worker < max(workers, (size_t)1); worker++)
+    {
+        _threads.emplace_back([this, worker] {
+            Task task;
+            while (_tasks.pop(task))
+                task(worker);
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    _tasks.close();
+    for (auto &thread : _threads)
+        thread.join();
+}
+
+size_t WorkerPool::default_workers()
+{
+    auto cores = thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void WorkerPool::submit(Task task) { _tasks.push(move(task)); }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "queue.hpp"
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Fixed number of threads running the tasks submitted to it, in order of submission
+//
+// Tasks wait in a bounded queue, so a producer that outruns the workers is held up in 'submit' rather than piling up
+// work. A task gets the index of the worker running it, to use resources of that worker's own (a solver, say)
+// without locking.
+//
+class WorkerPool
+{
+  public:
+    using Task = std::function<void(std::size_t worker)>;
+
+    explicit WorkerPool(std::size_t workers = default_workers(), std::size_t capacity = 1024);
+
+    // Runs the tasks still queued before it returns
+    ~WorkerPool();
+
+    WorkerPool(WorkerPool const &) = delete;
+    WorkerPool &operator=(WorkerPool const &) = delete;
+
+    // As many as there are cores
+    static auto default_workers() -> std::size_t;
+
+    /*
+        Queries:
+    */
+
+    auto workers() const -> std::size_t { return _threads.size(); }
+
+    // Tasks queued, not yet picked up by a worker
+    auto depth() const -> std::size_t { return _tasks.size(); }
+
+    /*
+        Commands:
+    */
+
+    // Queues a task, waiting for room
+    void submit(Task task);
+
+  private:
+    BoundedQueue<Task> _tasks;
+    std::vector<std::thread> _threads;
+};
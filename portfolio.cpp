@@ -0,0 +1,125 @@
+#include "portfolio.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// What the strategies racing on a cube share; outlives the solve, for those still running past the deadline
+struct Race {
+    explicit Race(size_t strategies) : cancel(strategies), bound(strategies, 0.0), running(strategies) {}
+
+    std::mutex mutex;
+    condition_variable changed;
+    vector<atomic<bool>> cancel;
+    vector<double> bound; // by strategy: the cost of what it has emitted so far
+    size_t running;
+    bool found = false;
+    vector<Solver::Step> best;
+    double best_cost = numeric_limits<double>::infinity();
+    size_t winner = 0;
+    exception_ptr error; // of the first strategy that failed, other than by being cancelled
+};
+
+} // namespace
+
+namespace detail {
+
+constexpr chrono::milliseconds::rep PortfolioSolver::DEFAULT_DEADLINE;
+
+PortfolioSolver::PortfolioSolver(vector<Strategy> const &strategies, Measure measure, chrono::milliseconds deadline)
+    : _strategies(strategies), _measure(measure), _deadline(deadline)
+{
+    if (_strategies.empty() || find(_strategies.begin(), _strategies.end(), PORTFOLIO) != _strategies.end())
+        throw invalid_argument("portfolio solver: needs strategies, other than a portfolio");
+    _pool.reset(new WorkerPool(_strategies.size()));
+}
+
+uint32_t PortfolioSolver::config_id() const
+{
+    uint32_t raced = 0;
+    for (auto strategy : _strategies)
+        raced |= 1u << strategy;
+    return PORTFOLIO | (uint32_t)_measure << 16 | raced << 24;
+}
+
+void PortfolioSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
+{
+    auto deadline = chrono::steady_clock::now() + _deadline;
+    auto race = make_shared<Race>(_strategies.size());
+
+    for (size_t i = 0; i < _strategies.size(); i++)
+    {
+        _pool->submit([this, race, i, cube](size_t) {
+            auto solver = Solver::Create(_strategies[i]);
+            solver->set_cancel(&race->cancel[i]);
+            solver->set_placement(placement());
+            auto turned = cube;
+            vector<Step> steps;
+            try
+            {
+                solver->solve(turned, [this, race, i, &steps](vector<Step> const &stage) {
+                    steps.insert(steps.end(), stage.begin(), stage.end());
+                    auto so_far = cost(steps, _measure);
+                    lock_guard<std::mutex> lock(race->mutex);
+                    if (so_far >= race->best_cost)
+                        throw Cancelled();
+                    race->bound[i] = so_far;
+                });
+
+                auto total = cost(steps, _measure);
+                lock_guard<std::mutex> lock(race->mutex);
+                if (turned.solved() && total < race->best_cost)
+                {
+                    race->found = true;
+                    race->best = steps;
+                    race->best_cost = total;
+                    race->winner = i;
+                    for (size_t other = 0; other < race->bound.size(); other++)
+                        if (other != i && race->bound[other] >= total)
+                            race->cancel[other] = true;
+                }
+            }
+            catch (Cancelled const &)
+            {
+            }
+            catch (...)
+            {
+                lock_guard<std::mutex> lock(race->mutex);
+                if (!race->error)
+                    race->error = current_exception();
+            }
+
+            lock_guard<std::mutex> lock(race->mutex);
+            race->running--;
+            race->changed.notify_all();
+        });
+    }
+
+    unique_lock<std::mutex> lock(race->mutex);
+    race->changed.wait_until(lock, deadline, [&race] { return race->running == 0; });
+    race->changed.wait(lock, [&race] { return race->running == 0 || race->found; });
+    for (auto &cancel : race->cancel)
+        cancel = true;
+    if (!race->found && race->error)
+        rethrow_exception(race->error);
+    if (!race->found)
+        throw runtime_error("portfolio: no strategy solved the cube");
+
+    auto steps = race->best;
+    log() << "portfolio: " << _strategies[race->winner] << " wins with a cost of " << race->best_cost << ", "
+          << race->running << " still running\n";
+    lock.unlock();
+
+    apply(steps, cube);
+    emit(steps);
+}
+
+} // namespace detail
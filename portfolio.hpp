@@ -0,0 +1,42 @@
+#pragma once
+
+#include "pool.hpp"
+#include "solver.hpp"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace detail {
+
+// Races several strategies on the cube, and keeps the best solution found by a deadline
+//
+// Each strategy solves a copy of the cube on a pool of its own, with a cancellation flag of its own. The solution that
+// costs the least (turns, or seconds on the crawler) wins. A strategy is cancelled once what it has emitted so far
+// costs as much as the best solution known: it can't do better anymore. At the deadline, the rest are cancelled too,
+// unless none has solved the cube yet: then the first solution to come in wins. A strategy that fails, or leaves the
+// cube unsolved, doesn't count. The winner is emitted at once.
+//
+class PortfolioSolver final : public BaseSolver
+{
+  public:
+    static constexpr std::chrono::milliseconds::rep DEFAULT_DEADLINE = 200; // ms
+
+    explicit PortfolioSolver(std::vector<Strategy> const &strategies = {L123, CFOP, TWO_PHASE},
+                             Measure measure = MOVES,
+                             std::chrono::milliseconds deadline = std::chrono::milliseconds(DEFAULT_DEADLINE));
+    virtual ~PortfolioSolver() = default;
+
+    auto strategy() const -> Strategy override { return PORTFOLIO; };
+    auto config_id() const -> std::uint32_t override;
+
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
+
+  private:
+    std::vector<Strategy> _strategies;
+    Measure _measure;
+    std::chrono::milliseconds _deadline;
+    std::unique_ptr<WorkerPool> _pool;
+};
+
+} // namespace detail
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Queue of at most a given number of items, passing them from producers to consumers on other threads
+//
+// 'push' waits while the queue is full, 'pop' while it is empty. Closing the queue wakes everybody up: pushes are
+// refused from then on, and pops return what is left before they fail.
+//
+template <typename T> class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(std::size_t capacity) : _capacity(capacity), _closed(false) {}
+
+    BoundedQueue(BoundedQueue const &) = delete;
+    BoundedQueue &operator=(BoundedQueue const &) = delete;
+
+    /*
+        Queries:
+    */
+
+    bool closed() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _closed;
+    }
+
+    auto size() const -> std::size_t
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _items.size();
+    }
+
+    /*
+        Commands:
+    */
+
+    // Adds an item, waiting for room; returns false (dropping the item) if the queue is closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+        if (_closed)
+            return false;
+
+        _items.push_back(std::move(item));
+        _not_empty.notify_one();
+        return true;
+    }
+
+    // Takes the oldest item, waiting for one; returns false if the queue is closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+        if (_items.empty())
+            return false;
+
+        item = std::move(_items.front());
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    // Takes the oldest item if there is one, without waiting
+    bool try_pop(T &item)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty())
+            return false;
+
+        item = std::move(_items.front());
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+  private:
+    std::size_t const _capacity;
+    mutable std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+    std::deque<T> _items;
+    bool _closed;
+};
+
+// Queue of at most N - 1 items between a single producer and a single consumer thread, lock-free
+//
+// Neither side ever waits for the other: 'try_push' fails when the queue is full, 'try_pop' when it is empty. Head
+// and tail are on cache lines of their own, so that the two threads don't contend for them.
+//
+template <typename T, std::size_t N> class SpscQueue
+{
+  public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    SpscQueue(SpscQueue const &) = delete;
+    SpscQueue &operator=(SpscQueue const &) = delete;
+
+    /*
+        Queries:
+    */
+
+    bool empty() const { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire); }
+
+    /*
+        Commands:
+    */
+
+    // Adds an item (producer only); returns false if the queue is full
+    bool try_push(T const &item)
+    {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        std::size_t next = (tail + 1) % N;
+        if (next == _head.load(std::memory_order_acquire))
+            return false;
+
+        _items[tail] = item;
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Takes the oldest item (consumer only); returns false if the queue is empty
+    bool try_pop(T &item)
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+
+        item = _items[head];
+        _head.store((head + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    T _items[N];
+    alignas(64) std::atomic<std::size_t> _head; // next to pop
+    alignas(64) std::atomic<std::size_t> _tail; // next to push
+};
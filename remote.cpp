@@ -0,0 +1,418 @@
+#include "remote.hpp"
+#include "cubie.hpp"
+#include "service.hpp"
+#include "trace.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr char MAGIC[] = "CCRS";
+constexpr char VERSION = 1;
+constexpr size_t STATE_SIZE = 54;
+constexpr size_t MAX_FRAME = 4096; // bytes of payload, or of a line: a solve request takes 55, steps 1 each
+
+// Guards the output of the connection threads, so that their lines don't interleave
+std::mutex output;
+
+[[noreturn]] void fail(string const &what) { throw runtime_error("remote: " + what + ": " + strerror(errno)); }
+
+bool is_unix(string const &address) { return address.find('/') != string::npos; }
+
+// Opens a socket connected to, or listening at, the address
+int open_socket(string const &address, bool listening)
+{
+    if (is_unix(address))
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path))
+            throw invalid_argument("remote: socket path too long: " + address);
+        strcpy(addr.sun_path, address.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            fail("socket");
+        if (listening)
+        {
+            unlink(address.c_str()); // left by an earlier server
+            if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+            {
+                close(fd);
+                fail("listen at " + address);
+            }
+        }
+        else if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(fd);
+            fail("connect to " + address);
+        }
+        return fd;
+    }
+
+    auto colon = address.rfind(':');
+    if (colon == string::npos)
+        throw invalid_argument("remote: address is neither HOST:PORT nor a socket path: " + address);
+    auto host = address.substr(0, colon);
+    auto port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo *found = nullptr;
+    if (int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found))
+        throw runtime_error("remote: " + address + ": " + gai_strerror(error));
+
+    int fd = -1;
+    for (auto ai = found; ai != nullptr && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        int on = 1;
+        bool ok = listening ? setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0 &&
+                                  bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 8) == 0
+                            : connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        if (!ok)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0)
+        fail((listening ? "listen at " : "connect to ") + address);
+
+    int on = 1; // steps go out as soon as they are there
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// Frames over a connected socket
+class Connection
+{
+  public:
+    explicit Connection(int fd) : _fd(fd), _pos(0) {}
+    ~Connection() { close(_fd); }
+
+    Connection(Connection const &) = delete;
+    Connection &operator=(Connection const &) = delete;
+
+    void send(string const &bytes)
+    {
+        for (size_t sent = 0; sent < bytes.size();)
+        {
+            auto n = ::send(_fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno != EINTR)
+                fail("send");
+            sent += n < 0 ? 0 : n;
+        }
+    }
+
+    void send(remote::Frame type, string const &payload)
+    {
+        string frame(1, (char)type);
+        auto length = payload.size();
+        for (; length >= 0x80; length >>= 7)
+            frame.push_back((char)((length & 0x7f) | 0x80));
+        frame.push_back((char)length);
+        send(frame + payload);
+    }
+
+    // Reads exactly n bytes; returns false if the peer closed the connection before the first
+    bool receive(string &bytes, size_t n)
+    {
+        if (!fill(n))
+        {
+            if (_buffer.size() == _pos)
+                return false;
+            throw runtime_error("remote: connection closed halfway a frame");
+        }
+        bytes = _buffer.substr(_pos, n);
+        _pos += n;
+        return true;
+    }
+
+    // Whether the next bytes are these (without taking them)
+    bool next_is(string const &bytes) { return fill(bytes.size()) && _buffer.compare(_pos, bytes.size(), bytes) == 0; }
+
+    // Reads a line, without its newline; returns false if the peer closed the connection before it
+    bool receive_line(string &line)
+    {
+        size_t end;
+        while ((end = _buffer.find('\n', _pos)) == string::npos)
+        {
+            if (_buffer.size() - _pos > MAX_FRAME)
+                refuse("line too long");
+            if (!fill(_buffer.size() - _pos + 1))
+            {
+                if (_buffer.size() == _pos)
+                    return false;
+                end = _buffer.size(); // a last line without newline
+                break;
+            }
+        }
+        line = _buffer.substr(_pos, end - _pos);
+        _pos = min(end + 1, _buffer.size());
+        return true;
+    }
+
+    // Whether a whole line is in already
+    bool has_line() const { return _buffer.find('\n', _pos) != string::npos; }
+
+    // Ends the connection both ways, for whoever is waiting on it
+    void shutdown() { ::shutdown(_fd, SHUT_RDWR); }
+
+    bool receive(remote::Frame &type, string &payload)
+    {
+        string byte;
+        if (!receive(byte, 1))
+            return false;
+        type = (remote::Frame)byte[0];
+
+        size_t length = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (shift > 28 || !receive(byte, 1))
+                throw runtime_error("remote: bad frame");
+            length |= (size_t)(byte[0] & 0x7f) << shift;
+            if ((byte[0] & 0x80) == 0)
+                break;
+        }
+        if (length > MAX_FRAME)
+            refuse("frame too long");
+        if (!receive(payload, length))
+            throw runtime_error("remote: connection closed halfway a frame");
+        return true;
+    }
+
+  private:
+    // Drops a peer that sends more than it may, before buffering it
+    [[noreturn]] void refuse(string const &what)
+    {
+        shutdown();
+        throw runtime_error("remote: " + what + ", connection closed");
+    }
+
+    // Receives until at least n bytes are buffered; returns false if the peer closed the connection before
+    bool fill(size_t n)
+    {
+        while (_buffer.size() - _pos < n)
+        {
+            char chunk[4096];
+            auto got = recv(_fd, chunk, sizeof(chunk), 0);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0)
+                fail("receive");
+            if (got == 0)
+                return false;
+            _buffer.erase(0, _pos);
+            _pos = 0;
+            _buffer.append(chunk, got);
+        }
+        return true;
+    }
+
+    int _fd;
+    string _buffer;
+    size_t _pos;
+};
+
+string state_of(Rubiks const &cube)
+{
+    string state;
+    for (int pos = 0; pos < (int)STATE_SIZE; pos++)
+        state.push_back((char)cube.color((Rubiks::Face)(pos / 9 * 9), (Rubiks::Cell)(pos % 9)));
+    return state;
+}
+
+// Answers the requests on a connection, in order
+void handle(Connection &connection)
+{
+    string hello;
+    if (!connection.receive(hello, sizeof(MAGIC)) || hello != string(MAGIC, sizeof(MAGIC) - 1) + VERSION)
+        throw runtime_error("remote: not a cube-crawler client, or another version");
+
+    remote::Frame type;
+    string payload;
+    while (connection.receive(type, payload))
+    {
+        if (type != remote::SOLVE)
+            throw runtime_error("remote: unexpected frame from client");
+
+        auto start = chrono::steady_clock::now();
+        size_t count = 0;
+        try
+        {
+            if (payload.size() != 1 + STATE_SIZE || (uint8_t)payload[0] > Solver::PORTFOLIO)
+                throw invalid_argument("bad solve request");
+            Rubiks cube(payload.substr(1));
+            if (!cube.valid())
+                throw invalid_argument("not a valid cube");
+
+            auto solver = Solver::Create((Solver::Strategy)payload[0]);
+            solver->solve(cube, [&connection, &count](vector<Solver::Step> const &steps) {
+                connection.send(remote::STEPS, trace::pack(steps));
+                count += steps.size();
+            });
+            connection.send(remote::DONE, string());
+        }
+        catch (exception const &e)
+        {
+            connection.send(remote::ERROR, e.what());
+            lock_guard<std::mutex> lock(output);
+            cerr << "solve failed: " << e.what() << "\n";
+            continue;
+        }
+
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+        lock_guard<std::mutex> lock(output);
+        cout << "solved in " << elapsed.count() / 1000.0 << " ms, " << count << " steps\n";
+    }
+}
+
+} // namespace
+
+namespace remote {
+
+void serve(string const &address, function<bool()> const &interrupted)
+{
+    int fd = open_socket(address, true);
+    SolveService service;
+    cout << "serving at " << address << " (" << service.workers() << " workers)\n";
+
+    // A thread per connection, reaped once done (and the connection closed only then, so that its socket is still
+    // the client's when shut down)
+    struct Client {
+        shared_ptr<Connection> connection;
+        thread handler;
+        shared_ptr<atomic<bool>> done;
+    };
+    list<Client> clients;
+    auto reap = [&clients](bool all) {
+        for (auto it = clients.begin(); it != clients.end();)
+        {
+            if (!all && !*it->done)
+            {
+                ++it;
+                continue;
+            }
+            it->connection->shutdown(); // wakes up a handler still waiting on its client
+            it->handler.join();
+            it = clients.erase(it);
+        }
+    };
+
+    while (!interrupted())
+    {
+        reap(false);
+
+        pollfd listening = {fd, POLLIN, 0};
+        if (poll(&listening, 1, 200) <= 0) // to see interrupts
+            continue;
+
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        int on = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // (fails harmlessly on a Unix socket)
+        auto connection = make_shared<Connection>(client);
+        auto done = make_shared<atomic<bool>>(false);
+        thread handler([connection, done, &service, &interrupted] {
+            try
+            {
+                if (connection->next_is(string(MAGIC, sizeof(MAGIC) - 1)))
+                    handle(*connection);
+                else
+                    service.serve({[connection](string &line) { return connection->receive_line(line); },
+                                   [connection] { return connection->has_line(); },
+                                   [connection](string const &lines) { connection->send(lines); }},
+                                  interrupted);
+            }
+            catch (exception const &e)
+            {
+                lock_guard<std::mutex> lock(output);
+                cerr << e.what() << "\n";
+            }
+            *done = true;
+        });
+        clients.push_back({connection, move(handler), done});
+    }
+
+    reap(true);
+    close(fd);
+    if (is_unix(address))
+        unlink(address.c_str());
+}
+
+} // namespace remote
+
+namespace detail {
+
+RemoteSolver::RemoteSolver(string const &address, Strategy strategy) : _address(address), _strategy(strategy) {}
+
+void RemoteSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const { request(_strategy, cube, emit); }
+
+vector<Solver::Step> RemoteSolver::solve_state(Cubies const &state) const
+{
+    auto cube = state.facelets();
+    vector<Step> steps;
+    request(TWO_PHASE, cube,
+            [&steps](vector<Step> const &stage) { steps.insert(steps.end(), stage.begin(), stage.end()); });
+    return steps;
+}
+
+void RemoteSolver::request(Strategy strategy, Rubiks &cube, Emit const &emit) const
+{
+    Connection connection(open_socket(_address, false));
+    connection.send(string(MAGIC, sizeof(MAGIC) - 1) + VERSION);
+    connection.send(remote::SOLVE, string(1, (char)strategy) + state_of(cube));
+
+    remote::Frame type;
+    string payload;
+    while (connection.receive(type, payload))
+    {
+        switch (type)
+        {
+        case remote::STEPS:
+        {
+            auto steps = trace::unpack(payload);
+            apply(steps, cube);
+            emit(steps);
+            break;
+        }
+        case remote::DONE:
+            return;
+
+        case remote::ERROR:
+            throw runtime_error("remote: " + payload);
+
+        default:
+            throw runtime_error("remote: unexpected frame from server");
+        }
+    }
+    throw runtime_error("remote: server closed the connection");
+}
+
+} // namespace detail
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "solver.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Solving on another machine
+//
+// The brick's core is slow, and the tables of a heavy solver don't fit in its memory. So a 'cube-crawler serve'
+// process on a host solves cubes for crawlers that connect to it, over TCP (address HOST:PORT), or over a Unix socket
+// (address is a path) when on the same machine. The server streams the steps of each stage back as soon as its
+// solver commits to them, so the crawler starts running the first stage while the host works on the rest.
+//
+// Protocol: the client opens with "CCRS" and a version byte. Then both ways, frames of
+//    type (1 byte), payload length (varint), payload
+// The client sends SOLVE frames: the strategy (1 byte) and the cube's state (54 color characters, lrbfdu). The
+// server answers each with STEPS frames (the steps packed as in traces, a byte each), then DONE, or ERROR with a
+// message. Requests on a connection are answered in order, so a client may send the next before the last is done.
+//
+namespace remote {
+
+constexpr char const *DEFAULT_ADDRESS = "127.0.0.1:7330";
+
+enum Frame : std::uint8_t { SOLVE, STEPS, DONE, ERROR };
+
+// Serves solve requests at the address until interrupted: crawlers' (opening with "CCRS"), and lines of cubes to solve
+// in bulk otherwise, see SolveService; any number of connections at once
+void serve(std::string const &address, std::function<bool()> const &interrupted);
+
+} // namespace remote
+
+namespace detail {
+
+// Has a server solve the cube, and the random states of RANDOM_STATE scrambles (so the brick needs no two-phase tables)
+class RemoteSolver final : public BaseSolver
+{
+  public:
+    explicit RemoteSolver(std::string const &address, Strategy strategy = L123);
+    virtual ~RemoteSolver() = default;
+
+    auto strategy() const -> Strategy override { return _strategy; };
+
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
+    auto solve_state(Cubies const &state) const -> std::vector<Step> override;
+
+  private:
+    void request(Strategy strategy, Rubiks &cube, Emit const &emit) const;
+
+    std::string _address;
+    Strategy _strategy;
+};
+
+} // namespace detail
@@ -1,4 +1,6 @@
 #include "rubiks.hpp"
+#include "cubie.hpp"
+#include "twophase.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
@@ -172,7 +174,7 @@ bool Rubiks::valid() const
 {
     string centers = {_state[LEFT + CC],  _state[RIGHT + CC], _state[BACK + CC],
                       _state[FRONT + CC], _state[DOWN + CC],  _state[UP + CC]};
-    return check_multi_color(_state, 9) && check_multi_color(centers, 1);
+    return check_multi_color(_state, 9) && check_multi_color(centers, 1) && check_pieces();
 }
 
 bool Rubiks::solved() const
@@ -196,6 +198,8 @@ double Rubiks::entropy() const
     return entropy;
 }
 
+int Rubiks::distance_lower_bound() const { return twophase::distance_lower_bound(Cubies(*this)); }
+
 Rubiks::CenterPiece Rubiks::center_piece(Face face) const
 {
     Nibble nibble{face, Cell::CC, color(face, Cell::CC)};
@@ -289,6 +293,64 @@ Rubiks::Nibble Rubiks::match_nibble(Nibble const &nibble, size_t n) const
     throw invalid_argument("request for invalid nibble conjugate");
 }
 
+array<array<int, 2>, 12> const &Rubiks::edge_slots()
+{
+    static auto const slots = [] {
+        array<array<int, 2>, 12> result;
+        size_t n = 0;
+        for (int pos = 0; pos < 54; pos++)
+        {
+            int other = conjugate(pos, 2);
+            if (pos % 9 % 2 == 0 || other < pos)
+                continue; // not an edge, or seen already
+
+            auto on = [](int p, Face a, Face b) { return p / 9 * 9 == a || p / 9 * 9 == b; };
+            bool reference = on(pos, DOWN, UP) || (!on(other, DOWN, UP) && on(pos, BACK, FRONT));
+            result[n++] = reference ? array<int, 2>{{pos, other}} : array<int, 2>{{other, pos}};
+        }
+        return result;
+    }();
+    return slots;
+}
+
+array<array<int, 3>, 8> const &Rubiks::corner_slots()
+{
+    static auto const slots = [] {
+        // Outward normals (x right, y up, z front) of the faces, in Face order
+        static int const normals[6][3] = {{-1, 0, 0}, {1, 0, 0}, {0, 0, -1}, {0, 0, 1}, {0, -1, 0}, {0, 1, 0}};
+
+        array<array<int, 3>, 8> result;
+        size_t n = 0;
+        for (int pos = DOWN; pos < 54; pos++)
+        {
+            if (pos % 9 % 2 == 1 || pos % 9 == CC)
+                continue;
+
+            array<int, 3> slot = {{pos, conjugate(pos, 2), conjugate(pos, 3)}};
+            int const *a = normals[slot[0] / 9], *b = normals[slot[1] / 9], *c = normals[slot[2] / 9];
+            int det = a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) +
+                      a[2] * (b[0] * c[1] - b[1] * c[0]);
+            if (det < 0)
+                swap(slot[1], slot[2]);
+            result[n++] = slot;
+        }
+        return result;
+    }();
+    return slots;
+}
+
+int Rubiks::conjugate(int pos, size_t n)
+{
+    assert((n == 1 || n == 2 || n == 3) && "error: can only match nibble with 1st, 2nd or 3rd conjugate");
+    assert((pos % 9 % 2 == 0 || n != 3) && "error: side center has no 3rd conjugate");
+
+    if (n == 1 || pos % 9 == CC)
+        return pos;
+
+    auto match = pos % 9 % 2 == 1 ? _mscp2[pos] : n == 2 ? _mcp2[pos] : _mcp3[pos];
+    return match.first + match.second;
+}
+
 void Rubiks::turn(Face face, int n)
 {
     n = n % 4; // 4 turns is identity
@@ -334,32 +396,43 @@ void Rubiks::rotate(Face axis, int n)
     n = n % 4;             // 4 rotations is identity
     n = n < 0 ? n + 4 : n; // express as CW rotation
 
-    vector<int> const *p = nullptr;
+    auto const &p = rotation(axis);
+    while (n-- > 0)
+    {
+        run_permutation(p);
+    }
+}
+
+int Rubiks::rotated(int pos, Face axis, int n)
+{
+    n = n % 4;             // 4 rotations is identity
+    n = n < 0 ? n + 4 : n; // express as CW rotation
+
+    auto const &p = rotation(axis);
+    while (n-- > 0)
+    {
+        pos = p[pos];
+    }
+    return pos;
+}
+
+vector<int> const &Rubiks::rotation(Face axis)
+{
     switch (axis)
     {
     case LEFT:
-        p = &_rlcw;
-        break;
+        return _rlcw;
     case RIGHT:
-        p = &_rrcw;
-        break;
+        return _rrcw;
     case BACK:
-        p = &_rbcw;
-        break;
+        return _rbcw;
     case FRONT:
-        p = &_rfcw;
-        break;
+        return _rfcw;
     case DOWN:
-        p = &_rdcw;
-        break;
+        return _rdcw;
     case UP:
-        p = &_rucw;
-        break;
-    }
-
-    while (n-- > 0)
-    {
-        run_permutation(*p);
+    default:
+        return _rucw;
     }
 }
 
@@ -426,6 +499,65 @@ bool Rubiks::check_single_color(string const &part) const
     return part == goal;
 }
 
+bool Rubiks::check_pieces() const
+{
+    // Which face each color belongs to, by the centers
+    array<int, 256> home;
+    home.fill(-1);
+    for (int face = LEFT; face <= UP; face += 9)
+        home[(unsigned char)_state[face + CC]] = face;
+
+    // Finds the slot a piece with the given colors (in slot order) belongs to, and its orientation there: how many
+    // nibbles on its reference color is; -1 if there is no such piece
+    auto identify = [&](vector<int> const &nibbles, vector<vector<int>> const &slots, int &orientation) -> int {
+        size_t k = nibbles.size();
+        for (size_t r = 0; r < k; r++)
+        {
+            for (size_t j = 0; j < slots.size(); j++)
+            {
+                bool match = true;
+                for (size_t m = 0; m < k && match; m++)
+                    match = home[(unsigned char)_state[nibbles[(m + r) % k]]] == slots[j][m] / 9 * 9;
+                if (match)
+                {
+                    orientation = (int)r;
+                    return (int)j;
+                }
+            }
+        }
+        return -1;
+    };
+
+    vector<vector<int>> edges, corners;
+    for (auto const &slot : edge_slots())
+        edges.push_back(vector<int>(slot.begin(), slot.end()));
+    for (auto const &slot : corner_slots())
+        corners.push_back(vector<int>(slot.begin(), slot.end()));
+
+    vector<int> edge_permutation, corner_permutation;
+    int flip = 0, twist = 0;
+    for (auto const &slot : edges)
+    {
+        int orientation = 0;
+        int piece = identify(slot, edges, orientation);
+        if (piece < 0 || find(edge_permutation.begin(), edge_permutation.end(), piece) != edge_permutation.end())
+            return false;
+        edge_permutation.push_back(piece);
+        flip += orientation;
+    }
+    for (auto const &slot : corners)
+    {
+        int orientation = 0;
+        int piece = identify(slot, corners, orientation);
+        if (piece < 0 || find(corner_permutation.begin(), corner_permutation.end(), piece) != corner_permutation.end())
+            return false;
+        corner_permutation.push_back(piece);
+        twist += orientation;
+    }
+
+    return flip % 2 == 0 && twist % 3 == 0 && parity(edge_permutation) == parity(corner_permutation);
+}
+
 Rubiks::Face opposite_of(Rubiks::Face face)
 {
     return face = face % 18 == 0 ? (Rubiks::Face)(face + 9) : (Rubiks::Face)(face - 9);
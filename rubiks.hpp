@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <iosfwd>
 #include <string>
 #include <tuple>
@@ -51,7 +52,8 @@ class Rubiks
         Queries:
     */
 
-    // Returns true iff instance represents a valid cube
+    // Returns true iff instance represents a valid cube: 9 of each color, distinct centers, real pieces only, and a
+    // solvable arrangement of those (corner twist, edge flip and permutation parity as reached by turns)
     bool valid() const;
 
     // Returns true iff instance represents a cube that has all colors in the right places
@@ -60,6 +62,10 @@ class Rubiks
     // Calculates a measure for how scrambled the cube is. 0 is solved. 1 = max. scrambled.
     auto entropy() const -> double;
 
+    // Turns it takes at least to solve the cube, see twophase::distance_lower_bound (its tables are built on first
+    // use); the cube must be valid
+    auto distance_lower_bound() const -> int;
+
     // Gets the color at a specific face + cell
     auto color(Face face, Cell cell) const -> Color;
 
@@ -72,6 +78,22 @@ class Rubiks
     // Finds the corner pieces that contain the specified color (1st nibble the one with matching color)
     auto corner_pieces(Color color) const -> std::array<CornerPiece, 4>;
 
+    // Gets the position (face + cell) a nibble at pos moves to when rotating the cube about axis n times
+    static auto rotated(int pos, Face axis, int n) -> int;
+
+    // Gets the position (face + cell) of the n-th (1, 2 or 3) conjugate of the nibble at pos, that is, of the other
+    // nibbles of the same piece
+    static auto conjugate(int pos, std::size_t n) -> int;
+
+    // Gets the slots (positions of their nibbles) of the edge pieces, reference nibble first (the one on UP or DOWN,
+    // else the one on FRONT or BACK), and of the corner pieces, the nibble on UP or DOWN first and the others in the
+    // same rotational order for all corners; so a piece in a slot other than its own is only ever rotated there
+    static auto edge_slots() -> std::array<std::array<int, 2>, 12> const &;
+    static auto corner_slots() -> std::array<std::array<int, 3>, 8> const &;
+
+    // Gets the parity (0 even, 1 odd) of a permutation of the numbers 0 to n - 1, n <= 32, such as of pieces over slots
+    template <typename Permutation> static int parity(Permutation const &permutation);
+
     /*
         Commands:
     */
@@ -97,8 +119,10 @@ class Rubiks
     int count_distinct_colors(std::string const &part) const;
     bool check_multi_color(std::string const &part, int n) const;
     bool check_single_color(std::string const &part) const;
+    bool check_pieces() const;
 
     void run_permutation(std::vector<int> const &permutation);
+    static auto rotation(Face axis) -> std::vector<int> const &;
     static std::vector<int> _tlcw, _trcw, _tbcw, _tfcw, _tdcw, _tucw;
     static std::vector<int> _rlcw, _rrcw, _rbcw, _rfcw, _rdcw, _rucw;
     static std::array<std::pair<Face, Cell>, 54> _mscp2;
@@ -128,4 +152,16 @@ std::ostream &operator<<(std::ostream &os, Rubiks::CenterPiece const &piece);
 std::ostream &operator<<(std::ostream &os, Rubiks::SideCenterPiece const &piece);
 std::ostream &operator<<(std::ostream &os, Rubiks::CornerPiece const &piece);
 
-inline Rubiks::Color Rubiks::color(Face face, Cell cell) const { return (Color)_state[face + cell]; }
\ No newline at end of file
+inline Rubiks::Color Rubiks::color(Face face, Cell cell) const { return (Color)_state[face + cell]; }
+
+template <typename Permutation> int Rubiks::parity(Permutation const &permutation)
+{
+    std::uint32_t seen = 0;
+    int inversions = 0;
+    for (auto p : permutation)
+    {
+        inversions += __builtin_popcount(seen >> p); // earlier and larger
+        seen |= 1u << p;
+    }
+    return inversions % 2;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "sampler.hpp"
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+Sample median_of(vector<Sample> samples)
+{
+    if (samples.empty())
+        throw runtime_error("sampler: no samples");
+
+    Sample median;
+    median.time = samples.back().time;
+    for (size_t v = 0; v < 3; v++)
+    {
+        auto mid = samples.begin() + samples.size() / 2;
+        nth_element(samples.begin(), mid, samples.end(),
+                    [v](Sample const &a, Sample const &b) { return a.values[v] < b.values[v]; });
+        median.values[v] = mid->values[v];
+    }
+    return median;
+}
+
+} // namespace
+
+constexpr size_t Sampler::CAPACITY;
+constexpr chrono::milliseconds Sampler::SETTLE_TIMEOUT;
+
+Sampler::Sampler(shared_ptr<Backend> backend, Backend::Sensor sensor, size_t values)
+    : _backend(backend), _sensor(sensor), _values(min(values, (size_t)3)), _motor(-1), _waiters(0), _stop(false)
+{
+}
+
+Sampler::~Sampler() { stop(); }
+
+Sample Sampler::latest() const
+{
+    auto samples = last(1);
+    if (samples.empty())
+        throw runtime_error("sampler: no samples");
+    return samples.back();
+}
+
+vector<Sample> Sampler::last(size_t n) const
+{
+    uint64_t count = _ring.count();
+    uint64_t from = count > n ? count - n : 0;
+    vector<Sample> samples;
+    _ring.read(from, samples);
+    return samples;
+}
+
+vector<Sample> Sampler::since(Backend::Duration time) const
+{
+    auto samples = last(CAPACITY);
+    auto first = find_if(samples.begin(), samples.end(), [time](Sample const &s) { return s.time >= time; });
+    samples.erase(samples.begin(), first);
+    return samples;
+}
+
+Sample Sampler::median(size_t n) const { return median_of(last(n)); }
+
+void Sampler::start()
+{
+    if (running())
+        return;
+
+    _motor = -1;
+    _stop = false;
+    _thread = thread(&Sampler::run, this);
+}
+
+void Sampler::start(Backend::Motor motor)
+{
+    if (running())
+        return;
+
+    _motor = motor;
+    _stop = false;
+    _thread = thread(&Sampler::run, this);
+}
+
+void Sampler::stop()
+{
+    if (!running())
+        return;
+
+    _stop = true;
+    _thread.join();
+}
+
+Sample Sampler::settled(Backend::Duration after, size_t n, chrono::milliseconds timeout)
+{
+    if (!running())
+        throw runtime_error("sampler: not running");
+
+    // On the wall clock: a virtual clock only moves while the sensor is read, so it stops along with the sensor
+    auto deadline = chrono::steady_clock::now() + timeout;
+    uint64_t from = _ring.count();
+    vector<Sample> samples;
+    auto enough = [&] {
+        _ring.read(from, samples);
+        samples.erase(remove_if(samples.begin(), samples.end(), [after](Sample const &s) { return s.time < after; }),
+                      samples.end());
+        return samples.size() >= n;
+    };
+
+    // Sleeps until the sampler has pushed enough (it wakes us with every sample while we wait)
+    unique_lock<mutex> lock(_mutex);
+    _waiters++;
+    atomic_thread_fence(memory_order_seq_cst); // see run
+    bool settled = _sampled.wait_until(lock, deadline, enough);
+    _waiters--;
+    if (!settled)
+        throw runtime_error("sampler: sensor not settled within " + to_string(timeout.count()) + " ms (" +
+                            to_string(samples.size()) + " of " + to_string(n) + " samples)");
+    samples.resize(n);
+    return median_of(samples);
+}
+
+void Sampler::run()
+{
+    while (!_stop)
+    {
+        // Time the sample halfway its reads
+        Sample sample = {};
+        auto before = _backend->now();
+        for (size_t v = 0; v < _values; v++)
+            sample.values[v] = _backend->value(_sensor, v);
+        if (_motor >= 0)
+            sample.position = _backend->position((Backend::Motor)_motor);
+        sample.time = before + (_backend->now() - before) / 2;
+        _ring.push(sample);
+
+        // Either a waiter sees the sample, or we see it waiting (it counts itself, then fences, then reads the ring)
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_waiters > 0)
+        {
+            lock_guard<mutex> lock(_mutex); // it is waiting then, or still reading, under the lock
+            _sampled.notify_all();
+        }
+
+        this_thread::yield(); // to the consumers, on a single core (as the brick's)
+    }
+}
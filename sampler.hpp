@@ -0,0 +1,176 @@
+#pragma once
+
+#include "backend.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Timestamped values of a sensor (as many as the sensor's mode has, up to 3)
+struct Sample {
+    Backend::Duration time; // on the backend's clock
+    std::array<int, 3> values;
+    int position; // of the motor tracked along, if any
+};
+
+// Ring buffer of the last N samples, written by a single producer and read by any number of consumers, lock-free
+//
+// Samples are numbered in the order they are pushed. A consumer keeps the number of the next sample it wants and
+// copies what is new since; it never holds up the producer, which overwrites the oldest samples when the ring is
+// full. A copy that raced with the producer is checked afterwards (like a seqlock), and samples that may have been
+// overwritten meanwhile are dropped from it.
+//
+template <std::size_t N> class SampleRing
+{
+  public:
+    SampleRing() : _count(0) {}
+
+    /*
+        Queries:
+    */
+
+    // Number of samples pushed so far
+    auto count() const -> std::uint64_t { return _count.load(std::memory_order_acquire); }
+
+    // Appends the samples from number 'from' on that are still in the ring to out, and sets 'from' to the number of
+    // the next sample; returns false if samples were lost (overwritten before they could be read)
+    bool read(std::uint64_t &from, std::vector<Sample> &out) const
+    {
+        std::uint64_t count = _count.load(std::memory_order_acquire);
+        std::uint64_t first = std::max(from, count > N ? count - N : 0);
+
+        std::size_t size = out.size();
+        for (std::uint64_t i = first; i < count; i++)
+        {
+            auto const &slot = _slots[i % N];
+            Sample sample;
+            sample.time = Backend::Duration(slot.time.load(std::memory_order_relaxed));
+            for (std::size_t v = 0; v < 3; v++)
+                sample.values[v] = slot.values[v].load(std::memory_order_relaxed);
+            sample.position = slot.position.load(std::memory_order_relaxed);
+            out.push_back(sample);
+        }
+
+        // The producer may have started on sample 'now' meanwhile, which overwrites sample now - N
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::uint64_t now = _count.load(std::memory_order_relaxed);
+        std::uint64_t valid = now + 1 > N ? now + 1 - N : 0;
+        if (valid > first)
+        {
+            auto overwritten = (std::size_t)std::min(valid - first, count - first);
+            out.erase(out.begin() + size, out.begin() + size + overwritten);
+        }
+
+        bool complete = from >= first && from >= valid;
+        from = count;
+        return complete;
+    }
+
+    /*
+        Commands:
+    */
+
+    // Adds a sample (producer only)
+    void push(Sample const &sample)
+    {
+        std::uint64_t i = _count.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // readers of the new data also see the count before it
+        auto &slot = _slots[i % N];
+        slot.time.store(sample.time.count(), std::memory_order_relaxed);
+        for (std::size_t v = 0; v < 3; v++)
+            slot.values[v].store(sample.values[v], std::memory_order_relaxed);
+        slot.position.store(sample.position, std::memory_order_relaxed);
+        _count.store(i + 1, std::memory_order_release);
+    }
+
+  private:
+    struct Slot {
+        std::atomic<std::int64_t> time;
+        std::atomic<int> values[3];
+        std::atomic<int> position;
+    };
+
+    Slot _slots[N];
+    std::atomic<std::uint64_t> _count;
+};
+
+// Samples a sensor as fast as it goes on a thread of its own, into a ring buffer
+//
+// Reading a sensor through sysfs takes a while, and the control thread shouldn't wait for that inline: with a
+// sampler running, it asks for the latest value, a median or the samples of a time window instead, without blocking.
+// The position of a motor can be sampled along, to know where the motor was at each sample.
+//
+// A sampler only runs between 'start' and 'stop', as it keeps the backend busy. On the brick, it takes a share of the
+// CPU. On a virtual clock, where every access takes time, a sampler runs the clock as fast as it samples; so there,
+// rather wait on its samples ('settled' sleeps until they are in) than poll the sensor alongside it.
+//
+class Sampler
+{
+  public:
+    static constexpr std::size_t CAPACITY = 4096;
+    static constexpr std::chrono::milliseconds SETTLE_TIMEOUT{1000}; // wall time for 'settled' (a sample takes ~ms)
+
+    Sampler(std::shared_ptr<Backend> backend, Backend::Sensor sensor, std::size_t values = 1);
+    ~Sampler();
+
+    Sampler(Sampler const &) = delete;
+    Sampler &operator=(Sampler const &) = delete;
+
+    /*
+        Queries:
+    */
+
+    bool running() const { return _thread.joinable(); }
+
+    // Number of samples taken so far
+    auto count() const -> std::uint64_t { return _ring.count(); }
+
+    // The most recent sample; throws if there is none yet
+    auto latest() const -> Sample;
+
+    // The most recent samples (at most n), oldest first
+    auto last(std::size_t n) const -> std::vector<Sample>;
+
+    // The samples taken at or after the given time that are still buffered, oldest first
+    auto since(Backend::Duration time) const -> std::vector<Sample>;
+
+    // Per value, the median of the most recent n samples (timed as the latest of them); throws if there are none
+    auto median(std::size_t n) const -> Sample;
+
+    // Appends the samples from number 'from' on to out, see SampleRing::read
+    bool read(std::uint64_t &from, std::vector<Sample> &out) const { return _ring.read(from, out); }
+
+    /*
+        Commands:
+    */
+
+    void start();
+    void start(Backend::Motor motor); // sampling its position along
+    void stop();
+
+    // Sleeps until n samples taken at or after the given time (while the sampler runs), and returns their median: a
+    // reading of a sensor that has settled after a motion; throws if they don't come within the timeout (wall time),
+    // as when the sensor stopped reporting
+    auto settled(Backend::Duration after, std::size_t n, std::chrono::milliseconds timeout = SETTLE_TIMEOUT)
+        -> Sample;
+
+  private:
+    void run();
+
+    std::shared_ptr<Backend> _backend;
+    Backend::Sensor _sensor;
+    std::size_t _values;
+    int _motor; // tracked along, -1 if none
+    SampleRing<CAPACITY> _ring;
+    std::mutex _mutex;                // only to sleep on _sampled, or to wake who does
+    std::condition_variable _sampled; // a sample pushed
+    std::atomic<int> _waiters;        // on _sampled
+    std::atomic<bool> _stop;
+    std::thread _thread;
+};
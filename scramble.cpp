@@ -0,0 +1,127 @@
+#include "scramble.hpp"
+#include <array>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+namespace {
+
+uint64_t splitmix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+constexpr int AXES = 3;
+constexpr int TURNS[] = {1, 2, -1};
+
+// Per axis of the last move (AXES before the first), the moves allowed next
+struct Moves {
+    array<array<Solver::Step, 18>, AXES + 1> steps;
+    array<uint32_t, AXES + 1> count;
+};
+
+Moves const &moves()
+{
+    static auto const moves = [] {
+        Moves result;
+        for (int last = 0; last <= AXES; last++)
+        {
+            uint32_t n = 0;
+            for (int face = Rubiks::LEFT; face <= Rubiks::UP; face += 9)
+            {
+                if (face / 18 == last) // an axis is LEFT/RIGHT, BACK/FRONT or DOWN/UP
+                    continue;
+                for (int turns : TURNS)
+                    result.steps[last][n++] = make_tuple(Solver::Turn, (Rubiks::Face)face, turns);
+            }
+            result.count[last] = n;
+        }
+        return result;
+    }();
+    return moves;
+}
+
+} // namespace
+
+Xoshiro256::Xoshiro256(uint64_t seed)
+{
+    for (auto &s : _s)
+        s = splitmix64(seed);
+}
+
+Xoshiro256::result_type Xoshiro256::operator()()
+{
+    uint64_t result = rotl(_s[1] * 5, 7) * 9;
+    uint64_t t = _s[1] << 17;
+    _s[2] ^= _s[0];
+    _s[3] ^= _s[1];
+    _s[1] ^= _s[2];
+    _s[0] ^= _s[3];
+    _s[2] ^= t;
+    _s[3] = rotl(_s[3], 45);
+    return result;
+}
+
+Scrambler::Sequence::Sequence(Xoshiro256 const &random) : _random(random), _axis(AXES) {}
+
+Solver::Step Scrambler::Sequence::next()
+{
+    auto const &table = moves();
+    auto const &step = table.steps[_axis][_random.below(table.count[_axis])];
+    _axis = get<1>(step) / 18;
+    return step;
+}
+
+Solver::Step Scrambler::Sequence::next(function<double(Solver::Step const &)> const &weight)
+{
+    auto const &table = moves();
+    auto const &steps = table.steps[_axis];
+    auto count = table.count[_axis];
+
+    array<double, 18> weights;
+    double total = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+        total += weights[i] = weight(steps[i]);
+
+    auto pick = ldexp((double)(_random() >> 11), -53) * total; // in [0, total)
+    uint32_t i = 0;
+    while (i + 1 < count && (pick -= weights[i]) >= 0.0)
+        i++;
+    _axis = get<1>(steps[i]) / 18;
+    return steps[i];
+}
+
+Scrambler::Scrambler(uint64_t seed) : _seed(seed) {}
+
+uint64_t Scrambler::random_seed()
+{
+    random_device device;
+    return (uint64_t)device() << 32 | device();
+}
+
+Xoshiro256 Scrambler::random(uint64_t index) const
+{
+    uint64_t x = _seed;
+    uint64_t mixed = splitmix64(x) ^ index;
+    return Xoshiro256(splitmix64(mixed));
+}
+
+vector<Solver::Step> Scrambler::scramble(uint64_t index, size_t length) const
+{
+    vector<Solver::Step> steps(length);
+    scramble(index, steps.data(), length);
+    return steps;
+}
+
+void Scrambler::scramble(uint64_t index, Solver::Step *steps, size_t length) const
+{
+    auto sequence = this->sequence(index);
+    for (size_t i = 0; i < length; i++)
+        steps[i] = sequence.next();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "solver.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Random number generator xoshiro256** (Blackman & Vigna): fast, 256 bits of state, and good enough for scrambles
+class Xoshiro256
+{
+  public:
+    using result_type = std::uint64_t;
+
+    // Seeds the state through splitmix64, as its authors advise
+    explicit Xoshiro256(std::uint64_t seed);
+
+    static constexpr auto min() -> result_type { return 0; }
+    static constexpr auto max() -> result_type { return ~(result_type)0; }
+
+    auto operator()() -> result_type;
+
+    // A number in [0, n) from the high bits, without a rejection loop (biased by less than n / 2^32)
+    auto below(std::uint32_t n) -> std::uint32_t { return (std::uint32_t)(((*this)() >> 32) * n >> 32); }
+
+  private:
+    std::uint64_t _s[4];
+};
+
+// Random-move scrambles, reproducible from a seed and an index
+//
+// The n-th scramble of a seed is always the same, whatever was drawn before and on whatever thread: each scramble
+// has a generator of its own, seeded by hashing seed and index. So threads can generate scrambles of the same seed
+// side by side, without sharing anything.
+//
+// A move is a quarter turn either way or a half turn, of a face on another axis than the move before: the moves
+// allowed after each axis are in a table, so a move is a single draw.
+//
+class Scrambler
+{
+  public:
+    // The moves of a scramble, one at a time, as many as wanted
+    class Sequence
+    {
+      public:
+        explicit Sequence(Xoshiro256 const &random);
+        auto next() -> Solver::Step;
+
+        // A move drawn with chances in proportion to the weights given them, rather than all the same
+        auto next(std::function<double(Solver::Step const &)> const &weight) -> Solver::Step;
+
+      private:
+        Xoshiro256 _random;
+        int _axis; // of the last move, 3 before the first
+    };
+
+    explicit Scrambler(std::uint64_t seed = random_seed());
+
+    // A seed from the system's entropy source
+    static auto random_seed() -> std::uint64_t;
+
+    /*
+        Queries:
+    */
+
+    auto seed() const -> std::uint64_t { return _seed; }
+
+    // The generator of the index-th scramble
+    auto random(std::uint64_t index) const -> Xoshiro256;
+
+    auto sequence(std::uint64_t index) const -> Sequence { return Sequence(random(index)); }
+
+    auto scramble(std::uint64_t index, std::size_t length) const -> std::vector<Solver::Step>;
+
+    // Without allocating, for scrambles in bulk
+    void scramble(std::uint64_t index, Solver::Step *steps, std::size_t length) const;
+
+  private:
+    std::uint64_t _seed;
+};
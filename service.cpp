@@ -0,0 +1,226 @@
+#include "service.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+constexpr size_t STATE_SIZE = 54;
+
+struct Request {
+    uint64_t seq; // in the channel's input
+    string id;
+    string state;
+    Clock::time_point received;
+};
+
+// Writes the answers of a channel in the order of its requests, as they come in from the workers
+class Answers
+{
+  public:
+    explicit Answers(function<void(string const &)> write) : _write(move(write)), _next(0), _expected(0) {}
+
+    // Takes the next number in order
+    auto next() -> uint64_t { return _expected++; }
+
+    void put(uint64_t seq, string answer)
+    {
+        put(seq, [answer] { return answer; });
+    }
+
+    // An answer made only when its turn comes to be written, so that it knows of the answers before it
+    void put(uint64_t seq, function<string()> answer)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _pending[seq] = move(answer);
+
+        string out; // the answers now in order, written at once
+        for (auto it = _pending.begin(); it != _pending.end() && it->first == _next; it = _pending.erase(it), _next++)
+            out += it->second();
+        if (!out.empty())
+        {
+            _write(out);
+            _all_written.notify_all();
+        }
+    }
+
+    // Waits for the answers of all requests numbered so far
+    void wait()
+    {
+        unique_lock<mutex> lock(_mutex);
+        _all_written.wait(lock, [this] { return _next == _expected; });
+    }
+
+  private:
+    function<void(string const &)> _write;
+    mutex _mutex;
+    condition_variable _all_written;
+    map<uint64_t, function<string()>> _pending;
+    uint64_t _next;     // to write
+    uint64_t _expected; // read so far (by the reader only)
+};
+
+// Parses a request line; returns false if there is nothing on it
+bool parse(string line, Request &request)
+{
+    while (!line.empty() && isspace((unsigned char)line.back()))
+        line.pop_back();
+    auto begin = line.find_first_not_of(" \t");
+    if (begin == string::npos)
+        return false;
+    line.erase(0, begin);
+
+    auto space = line.find_first_of(" \t");
+    if (space == string::npos)
+    {
+        request.id.clear();
+        request.state = line;
+    }
+    else
+    {
+        request.id = line.substr(0, space);
+        request.state = line.substr(line.find_first_not_of(" \t", space));
+    }
+    return true;
+}
+
+double percentile(vector<uint32_t> sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+} // namespace
+
+constexpr size_t SolveService::BATCH;
+constexpr size_t SolveService::LATENCIES;
+
+SolveService::SolveService(Solver::Strategy strategy, size_t workers)
+    : _requests(0), _solved(0), _failed(0), _total(0), _pool(max(workers, (size_t)1), 256)
+{
+    for (size_t worker = 0; worker < _pool.workers(); worker++)
+        _solvers.push_back(Solver::Create(strategy));
+    _latencies.reserve(LATENCIES);
+}
+
+SolveService::Stats SolveService::stats() const
+{
+    Stats stats;
+    vector<uint32_t> latencies;
+    {
+        lock_guard<mutex> lock(_mutex);
+        stats.requests = _requests;
+        stats.solved = _solved;
+        stats.failed = _failed;
+        stats.mean = _requests > 0 ? (double)_total / _requests : 0.0;
+        latencies = _latencies;
+    }
+    stats.depth = _pool.depth();
+
+    sort(latencies.begin(), latencies.end());
+    stats.p50 = percentile(latencies, 0.50);
+    stats.p99 = percentile(latencies, 0.99);
+    stats.max = latencies.empty() ? 0.0 : latencies.back();
+    return stats;
+}
+
+void SolveService::serve(Channel const &channel, function<bool()> const &interrupted)
+{
+    auto answers = make_shared<Answers>(channel.write);
+    uint64_t requests = 0; // numbered so far, for those without an id
+
+    string line;
+    bool more = true;
+    while (more && !interrupted())
+    {
+        // The requests that are in already go along, up to a batch
+        vector<Request> batch;
+        do
+        {
+            more = channel.read_line(line);
+            Request request;
+            if (!more || !parse(line, request))
+                continue;
+
+            if (request.state == "stats")
+            {
+                answers->put(answers->next(), [this] {
+                    auto stats = this->stats();
+                    ostringstream os;
+                    os << "stats requests=" << stats.requests << " solved=" << stats.solved
+                       << " failed=" << stats.failed << " depth=" << stats.depth << " mean=" << (uint64_t)stats.mean
+                       << "us p50=" << (uint64_t)stats.p50 << "us p99=" << (uint64_t)stats.p99
+                       << "us max=" << (uint64_t)stats.max << "us\n";
+                    return os.str();
+                });
+                continue;
+            }
+
+            request.seq = answers->next();
+            requests++;
+            if (request.id.empty())
+                request.id = to_string(requests);
+            request.received = Clock::now();
+            batch.push_back(move(request));
+        } while (more && batch.size() < BATCH && channel.ready());
+
+        if (batch.empty())
+            continue;
+
+        auto task = make_shared<vector<Request>>(move(batch));
+        _pool.submit([this, task, answers](size_t worker) {
+            auto &solver = *_solvers[worker];
+            for (auto const &request : *task)
+            {
+                string result;
+                bool solved = false;
+                try
+                {
+                    if (request.state.size() != STATE_SIZE)
+                        throw invalid_argument("not the 54 colors of a cube");
+                    Rubiks cube(request.state);
+                    result = notation(solver.solve(cube));
+                    solved = true;
+                }
+                catch (exception const &e)
+                {
+                    result = e.what();
+                }
+
+                auto latency = chrono::duration_cast<chrono::microseconds>(Clock::now() - request.received).count();
+                account((uint32_t)latency, solved);
+
+                ostringstream answer;
+                answer << request.id << ' ';
+                if (solved)
+                    answer << latency << "us " << result << '\n';
+                else
+                    answer << "error " << result << '\n';
+                answers->put(request.seq, answer.str());
+            }
+        });
+    }
+
+    answers->wait();
+}
+
+void SolveService::account(uint32_t latency, bool solved)
+{
+    lock_guard<mutex> lock(_mutex);
+    if (_latencies.size() < LATENCIES)
+        _latencies.push_back(latency);
+    else
+        _latencies[_requests % LATENCIES] = latency;
+    _requests++;
+    (solved ? _solved : _failed)++;
+    _total += latency;
+}
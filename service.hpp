@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pool.hpp"
+#include "solver.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Solving cubes in bulk, a line each
+//
+// Starting a process per cube pays for the start and the solver's tables every time. The service keeps a solver per
+// worker of a pool as large as there are cores instead, and answers requests from any number of channels (stdin, or
+// the connections to 'cube-crawler serve') until their input ends. Requests are lines of
+//    [ID ]STATE
+// with STATE the 54 color characters of a cube, lrbfdu; without an id, a request is numbered by its place among the
+// requests (the lines that aren't blank, nor 'stats'), from 1.
+// The answers come in the order of the requests, a line each:
+//    ID LATENCYus STEPS
+//    ID error MESSAGE
+// with the steps in notation (see 'notation'), and the latency from reading the request to solving it. A 'stats'
+// line is answered, in turn, with the counters and latencies as of the answers before it:
+//    stats requests=N solved=N failed=N depth=N mean=Xus p50=Xus p99=Xus max=Xus
+//
+// A request is too little work for a task of its own: the requests that are already in when one is read (buffered)
+// go along in the same task, up to BATCH of them.
+//
+class SolveService
+{
+  public:
+    static constexpr std::size_t BATCH = 64;
+    static constexpr std::size_t LATENCIES = 8192; // kept for the percentiles
+
+    struct Stats {
+        std::uint64_t requests, solved, failed;
+        std::size_t depth; // batches waiting for a worker
+        double mean, p50, p99, max; // latency in µs, of the last LATENCIES requests (mean of all)
+    };
+
+    // Where requests come from and answers go to
+    struct Channel {
+        std::function<bool(std::string &)> read_line; // false at the end of the input
+        std::function<bool()> ready;                  // whether read_line has a line without waiting
+        std::function<void(std::string const &)> write; // whole lines, each ending in a newline
+    };
+
+    explicit SolveService(Solver::Strategy strategy = Solver::L123,
+                          std::size_t workers = WorkerPool::default_workers());
+
+    /*
+        Queries:
+    */
+
+    auto workers() const -> std::size_t { return _pool.workers(); }
+    auto stats() const -> Stats;
+
+    /*
+        Commands:
+    */
+
+    // Answers the requests on the channel until its input ends or interrupted, and all answers are written
+    void serve(Channel const &channel, std::function<bool()> const &interrupted);
+
+  private:
+    void account(std::uint32_t latency, bool solved);
+
+    std::vector<std::shared_ptr<Solver>> _solvers; // one per worker (before the pool, whose tasks use them)
+    mutable std::mutex _mutex;                       // guards the counters
+    std::uint64_t _requests, _solved, _failed;
+    std::uint64_t _total;                  // of the latencies, in µs
+    std::vector<std::uint32_t> _latencies; // of the last requests, as a ring
+    WorkerPool _pool;
+};
@@ -1,7 +1,16 @@
 #include "solver.hpp"
+#include "device_time.hpp"
+#include "optimize.hpp"
+#include "portfolio.hpp"
+#include "scramble.hpp"
+#include "twophase.hpp"
+#include <algorithm>
 #include <cassert>
-#include <ctime>
+#include <cmath>
 #include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
@@ -16,6 +25,12 @@ shared_ptr<Solver> Solver::Create(Strategy strategy)
     case Solver::CFOP:
         return make_shared<detail::CfopSolver>();
 
+    case Solver::TWO_PHASE:
+        return make_shared<detail::TwoPhaseSolver>();
+
+    case Solver::PORTFOLIO:
+        return make_shared<detail::PortfolioSolver>();
+
     default:
         assert(false && "missing implementation solver strategy");
         return nullptr;
@@ -46,46 +61,215 @@ std::ostream &operator<<(std::ostream &os, Solver::Step const &step)
     return os;
 }
 
+string notation(vector<Solver::Step> const &steps)
+{
+    ostringstream os;
+    for (auto const &step : steps)
+    {
+        Solver::Operation op;
+        Rubiks::Face face;
+        int n;
+        tie(op, face, n) = step;
+
+        if (op == Solver::Rotate && face == Rubiks::DOWN) // as the opposite rotation about UP
+            n = -n;
+        n = (n % 4 + 4) % 4;
+        if (n == 0)
+            continue;
+
+        if (os.tellp() > 0)
+            os << ' ';
+        if (op == Solver::Turn)
+            os << face;
+        else
+            os << 'y';
+        os << (n == 2 ? "2" : n == 3 ? "'" : "");
+    }
+    return os.str();
+}
+
+vector<Solver::Step> from_notation(string const &turns)
+{
+    static string const faces = "LRBFDU"; // by face / 9
+
+    vector<Solver::Step> steps;
+    istringstream is(turns);
+    string turn;
+    while (is >> turn)
+    {
+        auto face = faces.find(turn[0]);
+        if (face == string::npos || turn.size() > 2 || (turn.size() == 2 && turn[1] != '2' && turn[1] != '\''))
+            throw invalid_argument("not a turn: " + turn);
+        int n = turn.size() == 1 ? 1 : turn[1] == '2' ? 2 : -1;
+        steps.push_back(make_tuple(Solver::Turn, (Rubiks::Face)(face * 9), n));
+    }
+    return steps;
+}
+
+void apply(vector<Solver::Step> const &steps, Rubiks &cube)
+{
+    for (auto const &step : steps)
+    {
+        Solver::Operation op;
+        Rubiks::Face face;
+        int n;
+        tie(op, face, n) = step;
+
+        if (op == Solver::Turn)
+            cube.turn(face, n);
+        else
+            cube.rotate(face, n);
+    }
+}
+
+vector<Orientation> const &orientations()
+{
+    static auto const orientations = [] {
+        vector<Orientation> result;
+        set<array<Rubiks::Face, 6>> seen;
+        Orientation start;
+        for (int face = 0; face < 6; face++)
+            start.to[face] = (Rubiks::Face)(face * 9);
+        result.push_back(start);
+        seen.insert(start.to);
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            for (auto axis : {Rubiks::UP, Rubiks::BACK})
+            {
+                auto next = result[i];
+                next.rotations.push_back(make_tuple(Solver::Rotate, axis, 1));
+                for (auto &to : next.to)
+                    to = (Rubiks::Face)(Rubiks::rotated(to + Rubiks::CC, axis, 1) - Rubiks::CC);
+                if (seen.insert(next.to).second)
+                    result.push_back(next);
+            }
+        }
+        return result;
+    }();
+    return orientations;
+}
+
 namespace detail {
 
 constexpr size_t MIN_SCRAMBLE = 20;
-constexpr size_t FACES = 6;
-constexpr size_t CELLS = 9;
-constexpr size_t TURNS = 3;
+constexpr int SCRAMBLED_DISTANCE = 7; // a distance lower bound that nearly all states reach
+constexpr double TEMPERATURE = 1.0;   // seconds on the crawler that make a turn e times less likely
+
+BaseSolver::BaseSolver() : _scramble(RANDOM_MOVES), _cancel(nullptr), _seed(Scrambler::random_seed()), _scrambles(0) {}
 
-vector<Solver::Step> BaseSolver::scramble(Rubiks &cube, double min_entropy) const
+vector<Solver::Step> BaseSolver::solve(Rubiks &cube) const
 {
     vector<Solver::Step> steps;
-    static auto const op = Solver::Turn;
+    solve(cube, [&steps](vector<Solver::Step> const &stage) { steps.insert(steps.end(), stage.begin(), stage.end()); });
+    return steps;
+}
 
-    srand(time(nullptr)); // use current time as seed for random generator
-    auto rnd_step = [&]() {
-        Solver::Step step;
-        Rubiks::Face face;
-        int count;
+void BaseSolver::solve(Rubiks &cube, Emit const &emit) const
+{
+    if (!_history.empty())
+    {
+        auto history = move(_history); // tried once, whether it works or not
+        _history.clear();
+
+        // Checked on a copy: the cube may have been disturbed since, or not have been solved when scrambled
+        auto steps = optimize::shortened(optimize::inverse(history));
+        auto undone = cube;
+        apply(steps, undone);
+        if (undone.solved())
+        {
+            log() << "solved by undoing a history of " << history.size() << " steps, in " << steps.size() << "\n";
+            cube = undone;
+            emit(steps);
+            return;
+        }
+        log() << "the history doesn't solve the cube, solving from scratch\n";
+    }
+
+    if (cancelled())
+        throw Cancelled();
+    solve_from_scratch(cube, [this, &emit](vector<Step> const &stage) {
+        if (cancelled())
+            throw Cancelled();
+        emit(stage);
+    });
+}
+
+vector<Solver::Step> BaseSolver::scramble(Rubiks &cube, int min_distance) const
+{
+    Scrambler scrambler(_seed);
+    auto index = _scrambles++;
+
+    if (_scramble == RANDOM_STATE)
+    {
+        // The way back from a random state, backwards; drawn again while not as far from solved as asked
+        auto random = scrambler.random(index);
+        Rubiks scrambled;
+        vector<Solver::Step> steps;
         do
         {
-            int rnd_face = std::rand() % FACES;
-            int rnd_turns = 1 + std::rand() / ((RAND_MAX + 1u) / TURNS); // Simply 1 + rand() % something is biased!
-            int rnd_dir = std::rand() % 2;
-            step = make_tuple(op, (Rubiks::Face)(rnd_face * CELLS), (rnd_dir ? -1 : 1) * rnd_turns);
-            tie(ignore, face, count) = step;
-        } while (/* Don't scramble about the same axis twice in a row */ !steps.empty() &&
-                 ((face % 18 == 0 && get<1>(steps.back()) == face + 9) ||
-                  (face % 18 == 9 && get<1>(steps.back()) == face - 9) || face == get<1>(steps.back())));
-        cube.turn(face, count);
-        steps.push_back(step);
+            auto solution = solve_state(Cubies::random(random));
+            steps.clear();
+            for (auto it = solution.rbegin(); it != solution.rend(); ++it)
+                steps.push_back(make_tuple(Solver::Turn, get<1>(*it), get<2>(*it) == 2 ? 2 : -get<2>(*it)));
+
+            scrambled = cube;
+            for (auto const &step : steps)
+                scrambled.turn(get<1>(step), get<2>(step));
+        } while (min_distance > 0 && scrambled.distance_lower_bound() < min_distance);
+
+        cube = scrambled;
+        return steps;
+    }
+
+    auto sequence = scrambler.sequence(index);
+
+    if (_scramble == DEVICE_TIME)
+    {
+        // Mostly turns of the face on the turntable, which needs no flips to get there: some 5 s on the crawler
+        // instead of 9 to 11. Only as many as it takes to be as far from solved as nearly all states, by the bound.
+        DeviceTime time(_placement);
+        vector<Solver::Step> steps;
+        while (cube.distance_lower_bound() < max(min_distance, SCRAMBLED_DISTANCE))
+        {
+            steps.push_back(sequence.next(
+                [&time](Step const &step) { return exp(-time.cost(get<1>(step), get<2>(step)) / TEMPERATURE); }));
+            time.run(steps.back());
+            cube.turn(get<1>(steps.back()), get<2>(steps.back()));
+        }
+        log() << "scrambled in " << steps.size() << " turns, " << time.seconds() << " s on the crawler\n";
+        return steps;
+    }
+
+    vector<Solver::Step> steps;
+    auto step = [&]() {
+        steps.push_back(sequence.next());
+        cube.turn(get<1>(steps.back()), get<2>(steps.back()));
     };
 
     // Ought to be enough to be an interesting solve
     for (size_t i = 0; i < MIN_SCRAMBLE; i++)
-        rnd_step();
+        step();
 
-    // Continue scrambling until visually scrambled enough too
-    while (cube.entropy() < min_entropy)
-        rnd_step();
+    // Continue scrambling until as far from solved as asked too
+    while (min_distance > 0 && cube.distance_lower_bound() < min_distance)
+        step();
 
     return steps;
 }
 
+vector<Solver::Step> BaseSolver::solve_state(Cubies const &state) const { return twophase::solve(state); }
+
+double BaseSolver::cost(vector<Step> const &steps, Measure measure) const
+{
+    if (measure == DEVICE_SECONDS)
+        return DeviceTime::of(steps, _placement);
+    return count_if(steps.begin(), steps.end(), [](Step const &step) { return get<0>(step) == Turn; });
+}
+
+void BaseSolver::set_seed(uint64_t seed)
+{
+    _seed = seed;
+    _scrambles = 0;
+}
+
 } // namespace detail
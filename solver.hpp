@@ -1,31 +1,103 @@
 #pragma once
 
 #include "rubiks.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <iosfwd>
+#include <map>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <vector>
 
+struct Cubies;
+
 struct Solver {
 
     enum Strategy {
         L123, // See https://ruwix.com/the-rubiks-cube/how-to-solve-the-rubiks-cube-beginners-method/
-        CFOP  // See https://ruwix.com/the-rubiks-cube/advanced-cfop-fridrich/
+        CFOP, // See https://ruwix.com/the-rubiks-cube/advanced-cfop-fridrich/
+        TWO_PHASE, // See https://kociemba.org/cube.htm
+        PORTFOLIO  // the others at once, the best solution by a deadline, see portfolio.hpp
+    };
+    enum Scramble {
+        RANDOM_MOVES, // random turns, MIN_SCRAMBLE of them and more while not as far from solved as asked
+        RANDOM_STATE, // a state drawn uniformly from all states, and the turns that get there: fairer, and fewer
+        DEVICE_TIME   // random turns, favoring those the crawler runs fast, until as far from solved as a random state
     };
     enum Operation { Turn, Rotate };
     using Step = std::tuple<Operation, Rubiks::Face, int>;
+    using Emit = std::function<void(std::vector<Step> const &)>;
+    using Placement = std::map<Rubiks::Face, int>; // the device face (a Device::Face) of each face of the cube
+
+    // Thrown by a solve that gives up, see set_cancel
+    struct Cancelled : std::runtime_error {
+        Cancelled() : std::runtime_error("solve cancelled") {}
+    };
 
     static auto Create(Strategy strategy) -> std::shared_ptr<Solver>;
     virtual ~Solver() = default;
 
     virtual auto strategy() const -> Strategy = 0;
+
+    // Tells apart the setups that find different solutions for the same cube: the strategy in the low byte, then the
+    // orientations tried (see OrientingSolver), the measure they are chosen by, and for a portfolio a bit per strategy
+    // raced in the high byte
+    virtual auto config_id() const -> std::uint32_t = 0;
+
     virtual void set_log(std::ostream &os) = 0;
     virtual auto solve(Rubiks &cube) const -> std::vector<Step> = 0;
-    virtual auto scramble(Rubiks &cube, double min_entropy = 0.0) const -> std::vector<Step> = 0;
+
+    // Solves the cube stage by stage, handing the steps of each stage to emit as soon as the solver commits to them
+    // (on the calling thread), so they can be run while the solver works on the next stage
+    virtual void solve(Rubiks &cube, Emit const &emit) const = 0;
+
+    // Scrambles the cube, into a state min_distance turns from solved at least by Rubiks::distance_lower_bound
+    virtual auto scramble(Rubiks &cube, int min_distance = 0) const -> std::vector<Step> = 0;
+
+    virtual void set_scramble(Scramble scramble) = 0;
+
+    // The steps that took a solved cube to the next one to solve, if known: solving then undoes them, shortened (see
+    // optimize.hpp), in microseconds; unless they turn out not to solve the cube, which is then solved from scratch.
+    // Only the next solve tries them.
+    virtual void set_history(std::vector<Step> const &history) = 0;
+
+    // Where the cube's faces are on the crawler, as Device::permutation() tells, for DEVICE_TIME scrambles (by
+    // default, where the cube model has them)
+    virtual void set_placement(Placement const &placement) = 0;
+
+    // Makes the scrambles reproducible: the n-th scramble after seeding is the same for the same seed (by default,
+    // a solver is seeded at random)
+    virtual void set_seed(std::uint64_t seed) = 0;
+
+    // Has solves give up once the flag is set, by throwing Cancelled: between stages, and within searches (by default,
+    // solves run to the end)
+    virtual void set_cancel(std::atomic<bool> const *cancel) = 0;
 };
 
 std::ostream &operator<<(std::ostream &os, Solver::Step const &step);
 
+// The steps in the usual notation, separated by spaces: U, R', F2 for turns, y, y' for rotations about UP
+auto notation(std::vector<Solver::Step> const &steps) -> std::string;
+
+// The turns in the usual notation, as notation writes them (no rotations); throws std::invalid_argument otherwise
+auto from_notation(std::string const &turns) -> std::vector<Solver::Step>;
+
+// Turns and rotates the cube by the steps
+void apply(std::vector<Solver::Step> const &steps, Rubiks &cube);
+
+// An orientation of the cube as a whole: the rotations that get it there, and the face each face ends up at
+struct Orientation {
+    std::vector<Solver::Step> rotations;
+    std::array<Rubiks::Face, 6> to; // by face / 9
+};
+
+// The 24 orientations, breadth-first by quarter rotations about UP and BACK: the cube as it is comes first
+auto orientations() -> std::vector<Orientation> const &;
+
 namespace detail {
 
 class BaseSolver : public Solver
@@ -34,15 +106,49 @@ class BaseSolver : public Solver
     struct Logger {
         std::ostream *_os = nullptr;
     };
+    enum Measure { MOVES, DEVICE_SECONDS }; // of solutions: turns, or seconds on the crawler from the placement
+
+    BaseSolver();
     virtual ~BaseSolver() = default;
 
+    auto config_id() const -> std::uint32_t override { return strategy(); }
     auto log() const -> Logger const & { return _logger; }
     void set_log(std::ostream &os) override { _logger._os = &os; };
 
-    auto scramble(Rubiks &cube, double min_entropy = 0.0) const -> std::vector<Step> override;
+    // Collects what the streaming solve emits
+    auto solve(Rubiks &cube) const -> std::vector<Step> override;
+
+    // Undoes the history, if that solves the cube, else solves it from scratch, checking for cancellation per stage
+    void solve(Rubiks &cube, Emit const &emit) const override;
+
+    auto scramble(Rubiks &cube, int min_distance = 0) const -> std::vector<Step> override;
+    void set_scramble(Scramble scramble) override { _scramble = scramble; }
+    void set_placement(Placement const &placement) override { _placement = placement; }
+    void set_history(std::vector<Step> const &history) override { _history = history; }
+    void set_seed(std::uint64_t seed) override;
+    void set_cancel(std::atomic<bool> const *cancel) override { _cancel = cancel; }
+
+  protected:
+    auto placement() const -> Placement const & { return _placement; }
+    auto cancel() const -> std::atomic<bool> const * { return _cancel; }
+    bool cancelled() const { return _cancel != nullptr && *_cancel; }
+
+    auto cost(std::vector<Step> const &steps, Measure measure) const -> double;
+
+    // Solves the cube as Solver::solve does, without knowing how it got scrambled
+    virtual void solve_from_scratch(Rubiks &cube, Emit const &emit) const = 0;
+
+    // The turns that solve the state, for RANDOM_STATE scrambles (which take them backwards): by two-phase
+    virtual auto solve_state(Cubies const &state) const -> std::vector<Step>;
 
   private:
     Logger _logger;
+    Scramble _scramble;
+    Placement _placement;
+    mutable std::vector<Step> _history; // until the next solve tries it
+    std::atomic<bool> const *_cancel;
+    std::uint64_t _seed;
+    mutable std::atomic<std::uint64_t> _scrambles; // so far, since seeding
 };
 
 template <typename T> BaseSolver::Logger const &operator<<(BaseSolver::Logger const &logger, T value)
@@ -61,21 +167,18 @@ class L123Solver final : public BaseSolver
 
     auto strategy() const -> Strategy override { return L123; };
 
-    auto solve(Rubiks &cube) const -> std::vector<Step> override;
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
 
   private:
-    void solve_1st_layer(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_2nd_layer(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_3rd_layer(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_l1_cross(Rubiks &cube, std::vector<Step> &registry) const;
+    void solve_1st_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const;
+    void solve_2nd_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const;
+    void solve_3rd_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const;
+    void solve_l1_cross(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const;
     void solve_l1_cross_a(Rubiks &cube, std::vector<Step> &registry) const;
     void solve_l1_cross_b(Rubiks &cube, std::vector<Step> &registry) const;
     void solve_l1_corners(Rubiks &cube, std::vector<Step> &registry) const;
     void solve_l2_edges(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_l3_cross(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_l3_edges(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_l3_corners_permutation(Rubiks &cube, std::vector<Step> &registry) const;
-    void solve_l3_corners_orientation(Rubiks &cube, std::vector<Step> &registry) const;
 };
 
 class CfopSolver final : public BaseSolver
@@ -85,7 +188,20 @@ class CfopSolver final : public BaseSolver
 
     auto strategy() const -> Strategy override { return CFOP; };
 
-    auto solve(Rubiks &cube) const -> std::vector<Step> override;
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
+};
+
+// Solves in about 20 turns by search, see twophase.hpp; emits the solution at once
+class TwoPhaseSolver final : public BaseSolver
+{
+  public:
+    virtual ~TwoPhaseSolver() = default;
+
+    auto strategy() const -> Strategy override { return TWO_PHASE; };
+
+  protected:
+    void solve_from_scratch(Rubiks &cube, Emit const &emit) const override;
 };
 
 } // namespace detail
@@ -1,10 +1,25 @@
+#include "cfop.hpp"
 #include "solver.hpp"
-#include <stdexcept>
+#include <ostream>
 
 using namespace std;
 
 namespace detail {
 
-vector<Solver::Step> CfopSolver::solve(Rubiks &cube) const { throw runtime_error("CFOP Solver not implemented"); }
+void CfopSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
+{
+    Cubies state(cube);
+    auto stage = [&cube, &emit, this](char const *name, vector<Step> const &steps) {
+        log() << name << ": " << notation(steps) << "\n";
+        apply(steps, cube);
+        emit(steps);
+    };
+
+    stage("cross", cfop::cross(state));
+    for (auto pair = cfop::f2l_pair(state); !pair.empty(); pair = cfop::f2l_pair(state))
+        stage("F2L pair", pair);
+    stage("OLL", cfop::oll(state));
+    stage("PLL", cfop::pll(state));
+}
 
 } // namespace detail
@@ -1,3 +1,4 @@
+#include "cfop.hpp"
 #include "solver.hpp"
 #include <cassert>
 #include <cmath>
@@ -43,6 +44,14 @@ bool apply_steps(Rubiks &cube, std::vector<Solver::Step> &registry, size_t &curr
     return false;
 }
 
+// Hands the steps of a stage that is done to emit, and starts a new stage
+void commit(std::vector<Solver::Step> &registry, Solver::Emit const &emit)
+{
+    if (!registry.empty())
+        emit(registry);
+    registry.clear();
+}
+
 // Nbr of times to turn UP to align two centers matching the given corner key with the cell in UP
 int projected_distance_up(Rubiks const &cube, string const &cc_cols_key, Rubiks::Cell cell)
 {
@@ -247,44 +256,48 @@ int projected_distance_up(Rubiks const &cube, Rubiks::CornerPiece piece)
 
 namespace detail {
 
-vector<Solver::Step> L123Solver::solve(Rubiks &cube) const
+void L123Solver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
 {
     std::vector<Step> registry;
 
-    solve_1st_layer(cube, registry);
-    solve_2nd_layer(cube, registry);
-    // solve_3rd_layer(cube, registry);
-
-    return registry;
+    solve_1st_layer(cube, registry, emit);
+    solve_2nd_layer(cube, registry, emit);
+    solve_3rd_layer(cube, registry, emit);
 }
 
-void L123Solver::solve_1st_layer(Rubiks &cube, std::vector<Step> &registry) const
+void L123Solver::solve_1st_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const
 {
     log() << "1st layer\n";
-    solve_l1_cross(cube, registry);
+    solve_l1_cross(cube, registry, emit);
     solve_l1_corners(cube, registry);
+    commit(registry, emit);
 }
 
-void L123Solver::solve_2nd_layer(Rubiks &cube, std::vector<Step> &registry) const
+void L123Solver::solve_2nd_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const
 {
     log() << "2nd layer\n";
     solve_l2_edges(cube, registry);
+    commit(registry, emit);
 }
 
-void L123Solver::solve_3rd_layer(Rubiks &cube, std::vector<Step> &registry) const
+void L123Solver::solve_3rd_layer(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const
 {
     log() << "3rd layer\n";
-    solve_l3_cross(cube, registry);
-    solve_l3_edges(cube, registry);
-    solve_l3_corners_permutation(cube, registry);
-    solve_l3_corners_orientation(cube, registry);
+    // One look: the last layer's case, from its facelets, and the turns for it from a table (see cfop.hpp)
+    auto curr_step_idx = registry.size();
+    auto steps = cfop::last_layer(cube);
+    registry.insert(registry.end(), steps.begin(), steps.end());
+    apply_steps(cube, registry, curr_step_idx, log());
+    commit(registry, emit);
 }
 
-void L123Solver::solve_l1_cross(Rubiks &cube, std::vector<Step> &registry) const
+void L123Solver::solve_l1_cross(Rubiks &cube, std::vector<Step> &registry, Emit const &emit) const
 {
     log() << "1st layer :: cross\n";
     solve_l1_cross_a(cube, registry);
+    commit(registry, emit);
     solve_l1_cross_b(cube, registry);
+    commit(registry, emit);
 }
 
 void L123Solver::solve_l1_cross_a(Rubiks &cube, std::vector<Step> &registry) const
@@ -668,12 +681,4 @@ void L123Solver::solve_l2_edges(Rubiks &cube, std::vector<Step> &registry) const
     }
 }
 
-void L123Solver::solve_l3_cross(Rubiks &cube, std::vector<Step> &registry) const {}
-
-void L123Solver::solve_l3_edges(Rubiks &cube, std::vector<Step> &registry) const {}
-
-void L123Solver::solve_l3_corners_permutation(Rubiks &cube, std::vector<Step> &registry) const {}
-
-void L123Solver::solve_l3_corners_orientation(Rubiks &cube, std::vector<Step> &registry) const {}
-
 } // namespace detail
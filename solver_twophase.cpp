@@ -0,0 +1,21 @@
+#include "solver.hpp"
+#include "twophase.hpp"
+
+using namespace std;
+
+namespace detail {
+
+void TwoPhaseSolver::solve_from_scratch(Rubiks &cube, Emit const &emit) const
+{
+    auto steps = twophase::solve(Cubies(cube), twophase::MAX_LENGTH, twophase::MAX_NODES, cancel());
+    if (cancelled())
+        throw Cancelled();
+    for (auto const &step : steps)
+    {
+        cube.turn(get<1>(step), get<2>(step));
+        log() << step;
+    }
+    emit(steps);
+}
+
+} // namespace detail
@@ -0,0 +1,288 @@
+#include "states.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr char MAGIC[] = "CCST";
+constexpr char VERSION = 1;
+constexpr size_t STATE_SIZE = 54;
+constexpr size_t WORDS = (STATE_SIZE + 7) / 8;
+
+constexpr uint64_t ONES = 0x0101010101010101ull;
+constexpr uint64_t LOWS = 0x7f7f7f7f7f7f7f7full;
+constexpr uint64_t ALL = (1ull << STATE_SIZE) - 1;
+constexpr uint64_t CENTER_FACELETS = 1ull << 4 | 1ull << 13 | 1ull << 22 | 1ull << 31 | 1ull << 40 | 1ull << 49;
+constexpr uint8_t NONE = 0xff;
+
+// Bit i set iff byte i (in memory order, little-endian) of the word is c
+unsigned bytes_equal(uint64_t word, uint8_t c)
+{
+    uint64_t x = word ^ (ONES * c);
+    uint64_t zero = ~(((x & LOWS) + LOWS) | x | LOWS); // high bit of each zero byte
+    return (unsigned)(((zero >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+int popcount(uint64_t x) { return __builtin_popcountll(x); }
+
+// Pieces by the faces their colors belong to, in slot order: piece * k + orientation, NONE if there is no such piece
+struct Pieces {
+    array<uint8_t, 6 * 6> edges;
+    array<uint8_t, 6 * 6 * 6> corners;
+};
+
+Pieces const &pieces()
+{
+    static auto const pieces = [] {
+        Pieces result;
+        result.edges.fill(NONE);
+        result.corners.fill(NONE);
+
+        // A piece j in any slot, rotated r: the color at nibble (m + r) % k belongs to the face of its nibble m
+        auto const &edges = Rubiks::edge_slots();
+        for (size_t j = 0; j < edges.size(); j++)
+            for (int r = 1; r >= 0; r--)
+            {
+                int f[2];
+                for (int m = 0; m < 2; m++)
+                    f[(m + r) % 2] = edges[j][m] / 9;
+                result.edges[f[0] * 6 + f[1]] = (uint8_t)(j * 2 + r);
+            }
+        auto const &corners = Rubiks::corner_slots();
+        for (size_t j = 0; j < corners.size(); j++)
+            for (int r = 2; r >= 0; r--)
+            {
+                int f[3];
+                for (int m = 0; m < 3; m++)
+                    f[(m + r) % 3] = corners[j][m] / 9;
+                result.corners[(f[0] * 6 + f[1]) * 6 + f[2]] = (uint8_t)(j * 3 + r);
+            }
+        return result;
+    }();
+    return pieces;
+}
+
+} // namespace
+
+StateFile::StateFile(string const &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("states: cannot open " + path + ": " + strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        throw runtime_error("states: cannot read " + path + ": " + strerror(errno));
+    }
+
+    size_t size = st.st_size;
+    char const *data = nullptr;
+    if (size > 0)
+    {
+        auto mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            throw runtime_error("states: cannot map " + path + ": " + strerror(errno));
+        }
+        data = (char const *)mapped;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if (size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC) - 1) == 0 && data[sizeof(MAGIC) - 1] == VERSION)
+    {
+        size_t count = (size - sizeof(MAGIC)) / STATE_SIZE;
+        _states.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            add(data + sizeof(MAGIC) + i * STATE_SIZE, STATE_SIZE);
+        if ((size - sizeof(MAGIC)) % STATE_SIZE != 0) // a last, truncated state
+            add(data + sizeof(MAGIC) + count * STATE_SIZE, (size - sizeof(MAGIC)) % STATE_SIZE);
+    }
+    else
+    {
+        _states.reserve(size / (STATE_SIZE + 1));
+        for (char const *line = data, *end = data + size; line < end;)
+        {
+            auto newline = (char const *)memchr(line, '\n', end - line);
+            auto next = newline != nullptr ? newline + 1 : end;
+            auto last = newline != nullptr ? newline : end;
+
+            // The last word on the line
+            while (last > line && isspace((unsigned char)last[-1]))
+                last--;
+            auto first = last;
+            while (first > line && !isspace((unsigned char)first[-1]))
+                first--;
+            if (first < last)
+                add(first, last - first);
+            line = next;
+        }
+    }
+
+    if (data != nullptr)
+        munmap((void *)data, size);
+}
+
+StateFile::Reason StateFile::check(char const *state, size_t length, Packed &packed)
+{
+    packed = Packed{{0, 0, 0}};
+    if (length != STATE_SIZE)
+        return LENGTH;
+
+    uint64_t words[WORDS] = {};
+    memcpy(words, state, STATE_SIZE);
+
+    // Per color, a bit per facelet of that color
+    auto const &names = colors();
+    uint64_t masks[6];
+    uint64_t known = 0;
+    for (size_t c = 0; c < 6; c++)
+    {
+        masks[c] = 0;
+        for (size_t w = 0; w < WORDS; w++)
+            masks[c] |= (uint64_t)bytes_equal(words[w], (uint8_t)names[c]) << (8 * w);
+        masks[c] &= ALL;
+        known |= masks[c];
+    }
+    if (known != ALL)
+        return COLOR;
+
+    uint64_t faces[3] = {0, 0, 0}; // bit-sliced as the colors: the face each facelet's color belongs to
+    for (size_t c = 0; c < 6; c++)
+    {
+        if (popcount(masks[c]) != 9)
+            return COUNT;
+        if (popcount(masks[c] & CENTER_FACELETS) != 1)
+            return CENTERS;
+
+        auto face = __builtin_ctzll(masks[c] & CENTER_FACELETS) / 9;
+        for (int b = 0; b < 3; b++)
+        {
+            if ((c >> b) & 1)
+                packed.bits[b] |= masks[c];
+            if ((face >> b) & 1)
+                faces[b] |= masks[c];
+        }
+    }
+    auto face_of = [&faces](int pos) {
+        return (int)(((faces[0] >> pos) & 1) | ((faces[1] >> pos) & 1) << 1 | ((faces[2] >> pos) & 1) << 2);
+    };
+
+    auto const &table = pieces();
+    array<uint8_t, 12> edges;
+    uint32_t seen = 0;
+    int flip = 0;
+    for (size_t i = 0; i < 12; i++)
+    {
+        auto const &slot = Rubiks::edge_slots()[i];
+        auto piece = table.edges[face_of(slot[0]) * 6 + face_of(slot[1])];
+        if (piece == NONE || (seen >> (piece / 2)) & 1)
+            return PIECES;
+        seen |= 1u << (piece / 2);
+        edges[i] = piece / 2;
+        flip += piece % 2;
+    }
+
+    array<uint8_t, 8> corners;
+    seen = 0;
+    int twist = 0;
+    for (size_t i = 0; i < 8; i++)
+    {
+        auto const &slot = Rubiks::corner_slots()[i];
+        auto piece = table.corners[(face_of(slot[0]) * 6 + face_of(slot[1])) * 6 + face_of(slot[2])];
+        if (piece == NONE || (seen >> (piece / 3)) & 1)
+            return PIECES;
+        seen |= 1u << (piece / 3);
+        corners[i] = piece / 3;
+        twist += piece % 3;
+    }
+
+    if (flip % 2 != 0)
+        return FLIP;
+    if (twist % 3 != 0)
+        return TWIST;
+    if (Rubiks::parity(edges) != Rubiks::parity(corners))
+        return PARITY;
+    return OK;
+}
+
+string const &StateFile::colors()
+{
+    static string const colors = {Rubiks::RED,  Rubiks::ORANGE, Rubiks::GREEN,
+                                  Rubiks::BLUE, Rubiks::YELLOW, Rubiks::WHITE};
+    return colors;
+}
+
+char const *StateFile::describe(Reason reason)
+{
+    switch (reason)
+    {
+    case OK:
+        return "ok";
+    case LENGTH:
+        return "not 54 facelets";
+    case COLOR:
+        return "unknown color";
+    case COUNT:
+        return "not 9 of each color";
+    case CENTERS:
+        return "centers not distinct";
+    case PIECES:
+        return "no such piece, or twice";
+    case FLIP:
+        return "an edge flipped";
+    case TWIST:
+        return "a corner twisted";
+    case PARITY:
+        return "two pieces swapped";
+    }
+    return "?";
+}
+
+StateFile::Reason StateFile::reason(size_t row) const
+{
+    auto it = lower_bound(_reasons.begin(), _reasons.end(), make_pair(row, OK));
+    return it != _reasons.end() && it->first == row ? it->second : OK;
+}
+
+string StateFile::state(size_t row) const
+{
+    if (rejected(row))
+        return string();
+
+    auto const &names = colors();
+    auto const &packed = _states[row];
+    string state(STATE_SIZE, ' ');
+    for (size_t pos = 0; pos < STATE_SIZE; pos++)
+        state[pos] = names[(packed.bits[0] >> pos & 1) | (packed.bits[1] >> pos & 1) << 1 |
+                           (packed.bits[2] >> pos & 1) << 2];
+    return state;
+}
+
+void StateFile::add(char const *state, size_t length)
+{
+    size_t row = _states.size();
+    if (row % 64 == 0)
+        _rejected.push_back(0);
+
+    Packed packed;
+    auto reason = check(state, length, packed);
+    if (reason != OK)
+    {
+        _rejected.back() |= 1ull << (row % 64);
+        _reasons.emplace_back(row, reason);
+        packed = Packed{{0, 0, 0}};
+    }
+    _states.push_back(packed);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "rubiks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cube states in bulk, checked without exceptions
+//
+// Constructing a Rubiks per state of a large file costs a string and, for a bad state, an exception. A state file is
+// memory-mapped instead and its states are checked as they are, eight facelets at a time in 64-bit words (SWAR, which
+// works on the brick's ARM core as well as on a host): colors, the count of each, the centers, the pieces, their flip
+// and twist, and the permutation parity. What passes is kept packed, 3 bits per facelet; what doesn't is marked in a
+// bitmap, with the first check it failed.
+//
+// Text files have a line per state as for batch, [ID ]STATE; blank lines are skipped. Binary files have "CCST", a
+// version byte, and 54 color bytes per state.
+//
+class StateFile
+{
+  public:
+    enum Reason : std::uint8_t { OK, LENGTH, COLOR, COUNT, CENTERS, PIECES, FLIP, TWIST, PARITY };
+
+    // The color of each facelet as a 3-bit index (see 'colors'), bit-sliced: bit b of facelet p in bit p of word b
+    struct Packed {
+        std::uint64_t bits[3];
+    };
+
+    // Maps the file and checks all states in it; throws if the file can't be read, never for a state
+    explicit StateFile(std::string const &path);
+
+    // Checks the state, and packs it if it passes
+    static auto check(char const *state, std::size_t length, Packed &packed) -> Reason;
+
+    // The colors by index
+    static auto colors() -> std::string const &;
+
+    static auto describe(Reason reason) -> char const *;
+
+    /*
+        Queries:
+    */
+
+    // Number of states in the file, passed or not
+    auto size() const -> std::size_t { return _states.size(); }
+    auto accepted() const -> std::size_t { return _states.size() - _reasons.size(); }
+
+    bool rejected(std::size_t row) const { return (_rejected[row / 64] >> (row % 64)) & 1; }
+    auto reason(std::size_t row) const -> Reason;
+
+    auto packed(std::size_t row) const -> Packed const & { return _states[row]; }
+
+    // The state as a string of colors (lrbfdu); empty if rejected
+    auto state(std::size_t row) const -> std::string;
+
+    // The cube in a row that passed
+    auto cube(std::size_t row) const -> Rubiks { return Rubiks(state(row)); }
+
+  private:
+    void add(char const *state, std::size_t length);
+
+    std::vector<Packed> _states;                                 // per row, zero where rejected
+    std::vector<std::uint64_t> _rejected;                        // bitmap, per row
+    std::vector<std::pair<std::size_t, Reason>> _reasons;        // of the rejected rows, by row
+};
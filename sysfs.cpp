@@ -0,0 +1,362 @@
+#include "sysfs.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr long SYSFS_MAGIC = 0x62656572;
+
+// Preformatted command strings, written as-is
+constexpr char CMD_RESET[] = "reset";
+constexpr char CMD_STOP[] = "stop";
+constexpr char CMD_RUN_FOREVER[] = "run-forever";
+constexpr char CMD_RUN_TO_REL_POS[] = "run-to-rel-pos";
+
+// Formats value into the end of buf, returns a pointer to its first character
+char *format_int(int value, char *end)
+{
+    char *p = end;
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (value < 0)
+        *--p = '-';
+    return p;
+}
+
+// Finds the device directory in class_dir/subsystem whose address starts with the given address
+string find_device(string const &class_dir, char const *subsystem, string const &address)
+{
+    string dir = class_dir + "/" + subsystem;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+        return string();
+
+    string result;
+    while (dirent *entry = readdir(d))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        string candidate = dir + "/" + entry->d_name;
+        ifstream is(candidate + "/address");
+        string value;
+        if (getline(is, value) && value.compare(0, address.size(), address) == 0)
+        {
+            result = candidate;
+            break;
+        }
+    }
+    closedir(d);
+    return result;
+}
+
+void make_dirs(string const &path)
+{
+    for (size_t pos = path.find('/', 1); pos != string::npos; pos = path.find('/', pos + 1))
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        throw system_error(errno, system_category(), path);
+}
+
+void make_file(string const &path, string const &value)
+{
+    ofstream os(path);
+    if (!os)
+        throw runtime_error("cannot create " + path);
+    os << value << "\n";
+}
+
+} // namespace
+
+namespace sysfs {
+
+/*
+    Attribute:
+*/
+
+Attribute::Attribute(string const &dir, char const *name, int flags)
+    : _path(dir.empty() ? string() : dir + "/" + name), _fd(-1), _truncate(false)
+{
+    if (_path.empty())
+        return;
+
+    _fd = ::open(_path.c_str(), flags | O_CLOEXEC);
+    if (_fd < 0)
+        throw system_error(errno, system_category(), _path);
+
+    struct statfs fs;
+    _truncate = fstatfs(_fd, &fs) == 0 && (long)fs.f_type != SYSFS_MAGIC;
+}
+
+Attribute::~Attribute()
+{
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+size_t Attribute::read(char *buf, size_t size) const
+{
+    if (_fd < 0)
+        throw runtime_error("attribute not connected");
+
+    ssize_t n = ::pread(_fd, buf, size - 1, 0);
+    if (n < 0)
+        throw system_error(errno, system_category(), _path);
+
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+        --n;
+    buf[n] = '\0';
+    return (size_t)n;
+}
+
+int Attribute::read_int() const
+{
+    char buf[32];
+    read(buf, sizeof(buf));
+    return atoi(buf);
+}
+
+void Attribute::write(char const *value, size_t length)
+{
+    if (_fd < 0)
+        throw runtime_error("attribute not connected");
+
+    if (::pwrite(_fd, value, length, 0) < 0)
+        throw system_error(errno, system_category(), _path);
+
+    if (_truncate)
+        (void)::ftruncate(_fd, length);
+}
+
+void Attribute::write(int value)
+{
+    char buf[16];
+    char *end = buf + sizeof(buf);
+    char *begin = format_int(value, end);
+    write(begin, end - begin);
+}
+
+/*
+    Motor:
+*/
+
+Motor::Motor(string const &address, string const &class_dir)
+    : _dir(find_device(class_dir, "tacho-motor", address)), //
+      _command(_dir, "command", O_WRONLY),                  //
+      _state(_dir, "state", O_RDONLY),                      //
+      _position(_dir, "position", O_RDWR),                  //
+      _position_sp(_dir, "position_sp", O_RDWR),            //
+      _speed_sp(_dir, "speed_sp", O_RDWR),                  //
+      _stop_action(_dir, "stop_action", O_RDWR),            //
+      _cached(false), _cached_position_sp(0), _cached_speed_sp(0)
+{}
+
+int Motor::state() const
+{
+    char buf[128];
+    _state.read(buf, sizeof(buf));
+
+    int flags = 0;
+    char *rest = nullptr; // strtok_r, as the sampler and actuator threads read states too
+    for (char *token = strtok_r(buf, " ", &rest); token != nullptr; token = strtok_r(nullptr, " ", &rest))
+    {
+        if (strcmp(token, "running") == 0)
+            flags |= RUNNING;
+        else if (strcmp(token, "ramping") == 0)
+            flags |= RAMPING;
+        else if (strcmp(token, "holding") == 0)
+            flags |= HOLDING;
+        else if (strcmp(token, "overloaded") == 0)
+            flags |= OVERLOADED;
+        else if (strcmp(token, "stalled") == 0)
+            flags |= STALLED;
+    }
+    return flags;
+}
+
+int Motor::position() const { return _position.read_int(); }
+
+int Motor::position_sp() const { return _cached ? _cached_position_sp : _position_sp.read_int(); }
+
+void Motor::reset()
+{
+    _command.write(CMD_RESET, sizeof(CMD_RESET) - 1);
+    _cached = false; // driver restores its defaults
+    _cached_stop_action.clear();
+}
+
+void Motor::stop() { _command.write(CMD_STOP, sizeof(CMD_STOP) - 1); }
+
+void Motor::run_forever() { _command.write(CMD_RUN_FOREVER, sizeof(CMD_RUN_FOREVER) - 1); }
+
+void Motor::run_to_rel_pos() { _command.write(CMD_RUN_TO_REL_POS, sizeof(CMD_RUN_TO_REL_POS) - 1); }
+
+void Motor::set_stop_action(string const &action)
+{
+    if (action == _cached_stop_action)
+        return;
+    _stop_action.write(action);
+    _cached_stop_action = action;
+}
+
+void Motor::set_speed_sp(int speed)
+{
+    if (!_cached)
+    {
+        _cached_position_sp = _position_sp.read_int();
+        _cached_speed_sp = _speed_sp.read_int();
+        _cached = true;
+    }
+    if (speed == _cached_speed_sp)
+        return;
+    _speed_sp.write(speed);
+    _cached_speed_sp = speed;
+}
+
+void Motor::set_position_sp(int position)
+{
+    if (!_cached)
+    {
+        _cached_position_sp = _position_sp.read_int();
+        _cached_speed_sp = _speed_sp.read_int();
+        _cached = true;
+    }
+    if (position == _cached_position_sp)
+        return;
+    _position_sp.write(position);
+    _cached_position_sp = position;
+}
+
+/*
+    Sensor:
+*/
+
+Sensor::Sensor(string const &address, string const &class_dir)
+    : _dir(find_device(class_dir, "lego-sensor", address)), _mode(_dir, "mode", O_RDWR)
+{}
+
+int Sensor::value(size_t index) const
+{
+    if (index >= MAX_VALUES)
+        throw invalid_argument("index: sensor value index out of range");
+
+    auto &attribute = _values[index];
+    if (!attribute)
+    {
+        static char const *names[MAX_VALUES] = {"value0", "value1", "value2", "value3",
+                                                "value4", "value5", "value6", "value7"};
+        attribute.reset(new Attribute(_dir, names[index], O_RDONLY));
+    }
+    return attribute->read_int();
+}
+
+void Sensor::set_mode(string const &mode)
+{
+    if (mode == _cached_mode)
+        return;
+    _mode.write(mode);
+    _cached_mode = mode;
+}
+
+/*
+    Utilities:
+*/
+
+void fake(string const &class_dir)
+{
+    char const *motors[] = {OUTPUT_A, OUTPUT_B, OUTPUT_C};
+    for (int i = 0; i < 3; i++)
+    {
+        string dir = class_dir + "/tacho-motor/motor" + to_string(i);
+        make_dirs(dir);
+        make_file(dir + "/address", motors[i]);
+        make_file(dir + "/command", "");
+        make_file(dir + "/state", "");
+        make_file(dir + "/position", "0");
+        make_file(dir + "/position_sp", "0");
+        make_file(dir + "/speed_sp", "0");
+        make_file(dir + "/stop_action", "coast");
+    }
+
+    char const *sensors[] = {INPUT_1, INPUT_2, INPUT_4};
+    for (int i = 0; i < 3; i++)
+    {
+        string dir = class_dir + "/lego-sensor/sensor" + to_string(i);
+        make_dirs(dir);
+        make_file(dir + "/address", sensors[i]);
+        make_file(dir + "/mode", "");
+        for (int v = 0; v < 3; v++)
+            make_file(dir + "/value" + to_string(v), "0");
+    }
+}
+
+void benchmark(string const &class_dir, size_t iterations, ostream &os)
+{
+    using clock = chrono::steady_clock;
+
+    string dir = find_device(class_dir, "tacho-motor", OUTPUT_A);
+    if (dir.empty())
+        throw runtime_error("no motor at " + string(OUTPUT_A) + " in " + class_dir);
+
+    auto report = [&](char const *what, clock::duration elapsed) {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count() / (long long)iterations;
+        os << "  " << what << ": " << ns << " ns/access\n";
+    };
+
+    os << "per-attribute latency over " << iterations << " accesses in " << dir << "\n";
+
+    // The ev3dev-lang-cpp way: open, access and close on each call
+    auto start = clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        ofstream attribute(dir + "/position_sp");
+        attribute << (int)(i % 2 ? -215 : 215);
+    }
+    report("open/write/close position_sp", clock::now() - start);
+
+    start = clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        ifstream attribute(dir + "/state");
+        string value;
+        getline(attribute, value);
+    }
+    report("open/read/close state       ", clock::now() - start);
+
+    // The cached way
+    Attribute position_sp(dir, "position_sp", O_RDWR);
+    start = clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        position_sp.write((int)(i % 2 ? -215 : 215));
+    }
+    report("cached pwrite position_sp   ", clock::now() - start);
+
+    Attribute state(dir, "state", O_RDONLY);
+    start = clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        char buf[128];
+        state.read(buf, sizeof(buf));
+    }
+    report("cached pread state          ", clock::now() - start);
+}
+
+} // namespace sysfs
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+// Fast access to the ev3dev sysfs attributes of tacho motors and sensors.
+//
+// ev3dev-lang-cpp opens, accesses and closes an attribute file on every call. The classes in here look up their
+// device once, keep the attribute files open, and use pread/pwrite on preformatted buffers instead. Setpoints are
+// cached, so writing an unchanged value costs nothing. The sysfs class directory is passed in, so a fake directory
+// tree (e.g. one made by 'sysfs::fake') can stand in for the real one on any Linux box.
+//
+namespace sysfs {
+
+constexpr char const *CLASS_DIR = "/sys/class";
+
+constexpr char const *INPUT_1 = "ev3-ports:in1";
+constexpr char const *INPUT_2 = "ev3-ports:in2";
+constexpr char const *INPUT_3 = "ev3-ports:in3";
+constexpr char const *INPUT_4 = "ev3-ports:in4";
+constexpr char const *OUTPUT_A = "ev3-ports:outA";
+constexpr char const *OUTPUT_B = "ev3-ports:outB";
+constexpr char const *OUTPUT_C = "ev3-ports:outC";
+constexpr char const *OUTPUT_D = "ev3-ports:outD";
+
+// A single attribute file, kept open for the lifetime of the instance
+class Attribute
+{
+  public:
+    // Opens dir/name with the given open(2) flags, or leaves the attribute invalid if dir is empty
+    explicit Attribute(std::string const &dir, char const *name, int flags);
+    ~Attribute();
+
+    Attribute(Attribute const &) = delete;
+    Attribute &operator=(Attribute const &) = delete;
+
+    bool valid() const { return _fd >= 0; }
+
+    // Reads the value (without trailing newline) into buf, returns its length
+    auto read(char *buf, std::size_t size) const -> std::size_t;
+    auto read_int() const -> int;
+
+    void write(char const *value, std::size_t length);
+    void write(std::string const &value) { write(value.data(), value.size()); }
+    void write(int value);
+
+  private:
+    std::string _path;
+    int _fd;
+    bool _truncate; // regular files (fake trees) keep stale bytes after a shorter write, sysfs attributes don't
+};
+
+class Motor
+{
+  public:
+    enum State : int { RUNNING = 1, RAMPING = 2, HOLDING = 4, OVERLOADED = 8, STALLED = 16 };
+
+    /*
+        Construction & Destruction:
+    */
+
+    // Binds to the tacho motor at the given port address, if there is one
+    Motor(std::string const &address, std::string const &class_dir = CLASS_DIR);
+
+    /*
+        Queries:
+    */
+
+    bool connected() const { return _command.valid(); }
+    auto state() const -> int; // bitwise or of State flags
+    auto position() const -> int;
+    auto position_sp() const -> int;
+
+    /*
+        Commands:
+    */
+
+    void reset();
+    void stop();
+    void run_forever();
+    void run_to_rel_pos();
+    void set_stop_action(std::string const &action);
+    void set_speed_sp(int speed);
+    void set_position_sp(int position);
+
+  private:
+    std::string _dir;
+    Attribute _command;
+    Attribute _state;
+    Attribute _position;
+    Attribute _position_sp;
+    Attribute _speed_sp;
+    Attribute _stop_action;
+
+    // Last values written, to skip writing unchanged setpoints; invalidated by reset
+    bool _cached;
+    int _cached_position_sp;
+    int _cached_speed_sp;
+    std::string _cached_stop_action;
+};
+
+class Sensor
+{
+  public:
+    static constexpr std::size_t MAX_VALUES = 8;
+
+    /*
+        Construction & Destruction:
+    */
+
+    // Binds to the sensor at the given port address, if there is one
+    Sensor(std::string const &address, std::string const &class_dir = CLASS_DIR);
+
+    /*
+        Queries:
+    */
+
+    bool connected() const { return _mode.valid(); }
+    auto value(std::size_t index = 0) const -> int;
+
+    /*
+        Commands:
+    */
+
+    void set_mode(std::string const &mode);
+
+  private:
+    std::string _dir;
+    Attribute _mode;
+    std::string _cached_mode;
+    mutable std::array<std::unique_ptr<Attribute>, MAX_VALUES> _values; // opened on first use
+};
+
+// Creates a fake sysfs class tree under class_dir with the crawler's motors and sensors
+void fake(std::string const &class_dir);
+
+// Measures per-attribute latency of open/access/close (as ev3dev-lang-cpp does) versus cached descriptors
+void benchmark(std::string const &class_dir, std::size_t iterations, std::ostream &os);
+
+} // namespace sysfs
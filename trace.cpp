@@ -0,0 +1,422 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+constexpr char MAGIC[] = "CCTR";
+constexpr char VERSION = 2; // 1 had no SCAN records, and is read as such no more
+
+void write_varint(ostream &os, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        os.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    os.put((char)value);
+}
+
+uint64_t read_varint(string const &data, size_t &pos)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (pos >= data.size())
+            throw runtime_error("trace: truncated record");
+        auto byte = (uint8_t)data[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    throw runtime_error("trace: malformed varint");
+}
+
+uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+bool has_payload(trace::Op op)
+{
+    return op == trace::SET_STOP_ACTION || op == trace::SET_MODE || op == trace::SPEAK || op == trace::STEPS;
+}
+
+bool is_command(trace::Op op)
+{
+    return op == trace::RESET || op == trace::STOP || op == trace::RUN_FOREVER || op == trace::RUN_TO_REL_POS;
+}
+
+} // namespace
+
+namespace trace {
+
+string pack(vector<Solver::Step> const &steps)
+{
+    string payload;
+    payload.reserve(steps.size());
+    for (auto const &step : steps)
+    {
+        int n = get<2>(step);
+        assert(n >= -4 && n <= 3 && "step out of packable range");
+        payload.push_back((char)(get<0>(step) * 64 + get<1>(step) / 9 * 8 + (n + 4)));
+    }
+    return payload;
+}
+
+vector<Solver::Step> unpack(string const &payload)
+{
+    vector<Solver::Step> steps;
+    steps.reserve(payload.size());
+    for (char c : payload)
+    {
+        auto byte = (uint8_t)c;
+        auto op = (Solver::Operation)(byte / 64);
+        auto face = (Rubiks::Face)(byte / 8 % 8 * 9);
+        steps.emplace_back(op, face, byte % 8 - 4);
+    }
+    return steps;
+}
+
+} // namespace trace
+
+namespace detail {
+
+/*
+    RecordingBackend:
+*/
+
+RecordingBackend::RecordingBackend(shared_ptr<Backend> backend, string const &path)
+    : _backend(move(backend)), _os(path, ios::binary | ios::trunc), _last(0)
+{
+    if (!_os)
+        throw runtime_error("cannot create trace " + path);
+    _os.write(MAGIC, sizeof(MAGIC) - 1);
+    _os.put(VERSION);
+}
+
+int RecordingBackend::state(Motor motor)
+{
+    return timed(trace::STATE, motor, [&] { return _backend->state(motor); });
+}
+
+int RecordingBackend::position(Motor motor)
+{
+    return timed(trace::POSITION, motor, [&] { return _backend->position(motor); });
+}
+
+int RecordingBackend::value(Sensor sensor, size_t index)
+{
+    return timed(trace::VALUE, sensor | (int)index << 4, [&] { return _backend->value(sensor, index); });
+}
+
+void RecordingBackend::reset(Motor motor)
+{
+    timed(trace::RESET, motor, [&] { return _backend->reset(motor), 0; });
+}
+
+void RecordingBackend::stop(Motor motor)
+{
+    timed(trace::STOP, motor, [&] { return _backend->stop(motor), 0; });
+}
+
+void RecordingBackend::run_forever(Motor motor)
+{
+    timed(trace::RUN_FOREVER, motor, [&] { return _backend->run_forever(motor), 0; });
+}
+
+void RecordingBackend::run_to_rel_pos(Motor motor)
+{
+    timed(trace::RUN_TO_REL_POS, motor, [&] { return _backend->run_to_rel_pos(motor), 0; });
+}
+
+void RecordingBackend::set_stop_action(Motor motor, string const &action)
+{
+    auto start = _backend->now();
+    _backend->set_stop_action(motor, action);
+    write({trace::SET_STOP_ACTION, (uint8_t)motor, 0, start, _backend->now() - start, action});
+}
+
+void RecordingBackend::set_speed_sp(Motor motor, int speed)
+{
+    timed(trace::SET_SPEED_SP, motor, [&] { return _backend->set_speed_sp(motor, speed), speed; });
+}
+
+void RecordingBackend::set_position_sp(Motor motor, int position)
+{
+    timed(trace::SET_POSITION_SP, motor, [&] { return _backend->set_position_sp(motor, position), position; });
+}
+
+void RecordingBackend::set_mode(Sensor sensor, string const &mode)
+{
+    auto start = _backend->now();
+    _backend->set_mode(sensor, mode);
+    write({trace::SET_MODE, (uint8_t)sensor, 0, start, _backend->now() - start, mode});
+}
+
+void RecordingBackend::sleep_for(Duration duration)
+{
+    timed(trace::SLEEP, 0, [&] { return _backend->sleep_for(duration), (int)duration.count(); });
+}
+
+void RecordingBackend::speak(string const &msg)
+{
+    auto start = _backend->now();
+    _backend->speak(msg);
+    write({trace::SPEAK, 0, 0, start, _backend->now() - start, msg});
+}
+
+void RecordingBackend::scan() { write({trace::SCAN, 0, 0, _backend->now(), Duration(0), string()}); }
+
+void RecordingBackend::steps(vector<Solver::Step> const &steps)
+{
+    write({trace::STEPS, 0, (int32_t)steps.size(), _backend->now(), Duration(0), trace::pack(steps)});
+}
+
+template <typename F> int RecordingBackend::timed(trace::Op op, int target, F call)
+{
+    auto start = _backend->now();
+    int value = call();
+    write({op, (uint8_t)target, value, start, _backend->now() - start, string()});
+    return value;
+}
+
+void RecordingBackend::write(trace::Record const &record)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    _os.put((char)record.op);
+    _os.put((char)record.target);
+    write_varint(_os, zigzag(record.value));
+    write_varint(_os, zigzag((record.start - _last).count())); // calls from several threads may interleave
+    write_varint(_os, (uint64_t)record.duration.count());
+    if (has_payload(record.op))
+    {
+        write_varint(_os, record.payload.size());
+        _os.write(record.payload.data(), record.payload.size());
+    }
+    _last = record.start;
+}
+
+/*
+    ReplayBackend:
+*/
+
+ReplayBackend::ReplayBackend(string const &path) : _clock(0), _recorded(0), _next_script(0)
+{
+    ifstream is(path, ios::binary);
+    if (!is)
+        throw runtime_error("cannot open trace " + path);
+    string data((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+
+    size_t header = sizeof(MAGIC) - 1;
+    if (data.size() < header + 1 || data.compare(0, header, MAGIC) != 0)
+        throw runtime_error("not a cube-crawler trace: " + path);
+    if (data[header] != VERSION)
+        throw runtime_error("unsupported trace version in " + path);
+
+    Duration total[trace::SCAN + 1] = {};
+    long count[trace::SCAN + 1] = {};
+    bool open[3] = {false, false, false}; // is the last command to a motor still running
+
+    size_t pos = header + 1;
+    Duration last(0);
+    while (pos < data.size())
+    {
+        trace::Record record;
+        if (pos + 2 > data.size())
+            throw runtime_error("trace: truncated record");
+        record.op = (trace::Op)(uint8_t)data[pos++];
+        record.target = (uint8_t)data[pos++];
+        if (record.op > trace::SCAN)
+            throw runtime_error("trace: unknown record");
+        record.value = (int32_t)unzigzag(read_varint(data, pos));
+        record.start = last + Duration(unzigzag(read_varint(data, pos)));
+        record.duration = Duration(read_varint(data, pos));
+        if (has_payload(record.op))
+        {
+            size_t size = read_varint(data, pos);
+            if (pos + size > data.size())
+                throw runtime_error("trace: truncated record");
+            record.payload = data.substr(pos, size);
+            pos += size;
+        }
+        last = record.start;
+        _recorded = max(_recorded, record.start + record.duration);
+
+        total[record.op] += record.duration;
+        count[record.op]++;
+
+        int target = record.target & 0x0f;
+        if (is_command(record.op))
+        {
+            if (target > SCANNER)
+                throw runtime_error("trace: command to unknown motor");
+            _commands[target].push_back({record.op, record.start, Duration(0), {}});
+            open[target] = record.op == trace::RUN_FOREVER || record.op == trace::RUN_TO_REL_POS;
+        }
+        else if ((record.op == trace::STATE || record.op == trace::POSITION) && target <= SCANNER &&
+                 !_commands[target].empty())
+        {
+            auto &command = _commands[target].back();
+            auto since = record.start - command.start;
+            if (record.op == trace::POSITION)
+            {
+                command.positions.emplace_back(since, record.value);
+            }
+            else if (open[target])
+            {
+                // Running until first seen idle (run to position), or stalled (run forever)
+                bool done = command.op == trace::RUN_TO_REL_POS ? (record.value & RUNNING) == 0
+                                                                 : (record.value & STALLED) != 0;
+                if (done)
+                {
+                    command.busy = since;
+                    open[target] = false;
+                }
+                else
+                {
+                    command.busy = since + record.duration; // at least
+                }
+            }
+        }
+        else if (record.op == trace::VALUE)
+        {
+            _values[record.target].push_back(record.value);
+        }
+        else if (record.op == trace::SPEAK || record.op == trace::STEPS || record.op == trace::SCAN)
+        {
+            _script.push_back(move(record));
+        }
+    }
+
+    for (int op = 0; op <= trace::SCAN; op++)
+        _latency[op] = count[op] ? total[op] / count[op] : Duration(0);
+}
+
+int ReplayBackend::state(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    auto const &motion = _motions[motor];
+    auto since = _clock - motion.start;
+    elapse(trace::STATE);
+
+    if (motion.current == nullptr)
+        return 0;
+
+    switch (motion.current->op)
+    {
+    case trace::RUN_TO_REL_POS:
+        return since < motion.current->busy ? RUNNING : HOLDING;
+
+    case trace::RUN_FOREVER:
+        return RUNNING | (since < motion.current->busy ? 0 : STALLED);
+
+    default:
+        return 0;
+    }
+}
+
+int ReplayBackend::position(Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    auto const &motion = _motions[motor];
+    auto since = _clock - motion.start;
+    elapse(trace::POSITION);
+
+    if (motion.current == nullptr || motion.current->positions.empty())
+        return 0;
+
+    // The last position read at or before this time in the recording, else the first one
+    auto const &positions = motion.current->positions;
+    auto it = upper_bound(positions.begin(), positions.end(), make_pair(since, INT_MAX));
+    return it == positions.begin() ? it->second : prev(it)->second;
+}
+
+int ReplayBackend::value(Sensor sensor, size_t index)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::VALUE);
+
+    auto found = _values.find(sensor | (int)index << 4);
+    if (found == _values.end())
+        return 0;
+
+    // Samples in recorded order; holds the last one when the replay reads more often than the recording did
+    auto const &values = found->second;
+    auto &next = _next_value[found->first];
+    return values[min(next++, values.size() - 1)];
+}
+
+Backend::Duration ReplayBackend::now()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _clock;
+}
+
+void ReplayBackend::set_stop_action(Motor /*motor*/, string const & /*action*/)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::SET_STOP_ACTION);
+}
+
+void ReplayBackend::set_speed_sp(Motor /*motor*/, int /*speed*/)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::SET_SPEED_SP);
+}
+
+void ReplayBackend::set_position_sp(Motor /*motor*/, int /*position*/)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::SET_POSITION_SP);
+}
+
+void ReplayBackend::set_mode(Sensor /*sensor*/, string const & /*mode*/)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::SET_MODE);
+}
+
+void ReplayBackend::sleep_for(Duration duration)
+{
+    lock_guard<mutex> lock(_mutex);
+    _clock += duration;
+}
+
+void ReplayBackend::speak(string const & /*msg*/)
+{
+    lock_guard<mutex> lock(_mutex);
+    elapse(trace::SPEAK);
+}
+
+trace::Record const *ReplayBackend::next()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _next_script < _script.size() ? &_script[_next_script++] : nullptr;
+}
+
+void ReplayBackend::command(trace::Op op, Motor motor)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    auto &motion = _motions[motor];
+    auto const &commands = _commands[motor];
+    if (motion.next == commands.size() || commands[motion.next].op != op)
+        throw runtime_error("replay diverged from the trace at command #" + to_string(motion.next) + " to motor " +
+                            to_string(motor));
+
+    motion.current = &commands[motion.next++];
+    motion.start = _clock;
+    elapse(op);
+}
+
+void ReplayBackend::elapse(trace::Op op) { _clock += _latency[op]; }
+
+} // namespace detail
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "backend.hpp"
+#include "solver.hpp"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Record and replay of device sessions
+//
+// A recording backend wraps another backend and writes a compact binary trace of every call the device makes: motor
+// commands, setpoints, attribute reads and sensor samples with their values, when each call was made and how long it
+// took. What the session did on top of that (scanning the cube, running steps) is stored as well.
+//
+// A replay backend plays such a trace back on a virtual clock. It is not a tape, but a timeline per motor: the n-th
+// command to a motor keeps it running as long as it did in the recording, and position and sensor reads return what
+// was read then. So a changed polling or sampling strategy replays fine; a change in the motor commands themselves
+// is reported as a divergence.
+//
+// Trace format: "CCTR", version byte (2 since SCAN records), then records of
+//    op (1 byte), target (1 byte), value (zigzag varint), start (zigzag varint, us since the previous start, which
+//    calls from several threads may have made later), duration (varint, us)
+// followed by a length-prefixed payload for text (stop action, mode, speech) and step records.
+//
+namespace trace {
+
+enum Op : std::uint8_t {
+    STATE,
+    POSITION,
+    VALUE,
+    RESET,
+    STOP,
+    RUN_FOREVER,
+    RUN_TO_REL_POS,
+    SET_STOP_ACTION,
+    SET_SPEED_SP,
+    SET_POSITION_SP,
+    SET_MODE,
+    SLEEP,
+    SPEAK,
+    STEPS,
+    SCAN
+};
+
+struct Record {
+    Op op;
+    std::uint8_t target;      // motor or sensor (sensor value index in the high nibble)
+    std::int32_t value;       // read or written value
+    Backend::Duration start;  // since the start of the session
+    Backend::Duration duration;
+    std::string payload;      // text, or packed steps
+};
+
+auto pack(std::vector<Solver::Step> const &steps) -> std::string;
+auto unpack(std::string const &payload) -> std::vector<Solver::Step>;
+
+} // namespace trace
+
+namespace detail {
+
+class RecordingBackend final : public Backend
+{
+  public:
+    RecordingBackend(std::shared_ptr<Backend> backend, std::string const &path);
+
+    auto kind() const -> Kind override { return _backend->kind(); }
+
+    bool connected(Motor motor) const override { return _backend->connected(motor); }
+    bool connected(Sensor sensor) const override { return _backend->connected(sensor); }
+    auto state(Motor motor) -> int override;
+    auto position(Motor motor) -> int override;
+    auto value(Sensor sensor, std::size_t index = 0) -> int override;
+    auto now() -> Duration override { return _backend->now(); }
+
+    void reset(Motor motor) override;
+    void stop(Motor motor) override;
+    void run_forever(Motor motor) override;
+    void run_to_rel_pos(Motor motor) override;
+    void set_stop_action(Motor motor, std::string const &action) override;
+    void set_speed_sp(Motor motor, int speed) override;
+    void set_position_sp(Motor motor, int position) override;
+    void set_mode(Sensor sensor, std::string const &mode) override;
+    void sleep_for(Duration duration) override;
+    void speak(std::string const &msg) override;
+
+    // Stores that the session is about to scan the cube
+    void scan();
+
+    // Stores the steps the session is about to run
+    void steps(std::vector<Solver::Step> const &steps);
+
+  private:
+    template <typename F> auto timed(trace::Op op, int target, F call) -> int;
+    void write(trace::Record const &record);
+
+    std::shared_ptr<Backend> _backend;
+    std::ofstream _os;
+    std::mutex _mutex;
+    Duration _last;
+};
+
+class ReplayBackend final : public Backend
+{
+  public:
+    explicit ReplayBackend(std::string const &path);
+
+    auto kind() const -> Kind override { return REPLAY; }
+
+    bool connected(Motor /*motor*/) const override { return true; }
+    bool connected(Sensor /*sensor*/) const override { return true; }
+    auto state(Motor motor) -> int override;
+    auto position(Motor motor) -> int override;
+    auto value(Sensor sensor, std::size_t index = 0) -> int override;
+    auto now() -> Duration override;
+
+    void reset(Motor motor) override { command(trace::RESET, motor); }
+    void stop(Motor motor) override { command(trace::STOP, motor); }
+    void run_forever(Motor motor) override { command(trace::RUN_FOREVER, motor); }
+    void run_to_rel_pos(Motor motor) override { command(trace::RUN_TO_REL_POS, motor); }
+    void set_stop_action(Motor motor, std::string const &action) override;
+    void set_speed_sp(Motor motor, int speed) override;
+    void set_position_sp(Motor motor, int position) override;
+    void set_mode(Sensor sensor, std::string const &mode) override;
+    void sleep_for(Duration duration) override;
+    void speak(std::string const &msg) override;
+
+    // Gets the next thing the recorded session did besides driving the hardware (SPEAK, SCAN or STEPS), nullptr if
+    // there is nothing left
+    auto next() -> trace::Record const *;
+
+    // Duration of the recorded session
+    auto recorded() const -> Duration { return _recorded; }
+
+  private:
+    struct Command {
+        trace::Op op;
+        Duration start;                                   // in the recording
+        Duration busy;                                    // running (or until stalled) for this long
+        std::vector<std::pair<Duration, int>> positions; // position reads, relative to the command
+    };
+    struct Motion {
+        std::size_t next = 0;      // index of the next command
+        Command const *current = nullptr;
+        Duration start{0};
+    };
+
+    void command(trace::Op op, Motor motor);
+    void elapse(trace::Op op);
+
+    std::mutex _mutex;
+    Duration _clock;
+    Duration _recorded;
+    std::vector<Command> _commands[3];
+    Motion _motions[3];
+    std::map<int, std::vector<int>> _values; // per sensor and value index
+    std::map<int, std::size_t> _next_value;
+    std::vector<trace::Record> _script; // speech, scans and steps, in order
+    std::size_t _next_script;
+    Duration _latency[trace::SCAN + 1]; // mean duration per kind of call
+};
+
+} // namespace detail
@@ -0,0 +1,481 @@
+#include "twophase.hpp"
+#include <algorithm>
+#include <array>
+
+using namespace std;
+
+namespace {
+
+constexpr int MOVES = 18; // a move is face * 3 + (quarter turn, half turn, quarter turn back)
+constexpr int TURNS[] = {1, 2, -1};
+constexpr int PHASE2_MOVES = 10;
+constexpr int TWISTS = 2187, FLIPS = 2048, SLICES = 495;
+constexpr int CPERMS = 40320, UDPERMS = 40320, SLICEPERMS = 24;
+constexpr int NO_MOVE = -1;
+constexpr uint8_t UNSEEN = 0xf;
+
+Rubiks::Face face_of(int move) { return (Rubiks::Face)(move / 3 * 9); }
+
+Cubies const &cubies_of(int move) { return Cubies::turn(face_of(move), TURNS[move % 3]); }
+
+// Whether the move is redundant after the last one: the same face again, or the opposite face in the other order
+bool redundant(int move, int last)
+{
+    if (last == NO_MOVE)
+        return false;
+    int face = move / 3, last_face = last / 3;
+    return face == last_face || (face / 2 == last_face / 2 && face < last_face);
+}
+
+// Depths of a pruning table, packed two to a byte (they all stay below UNSEEN)
+class Depths
+{
+  public:
+    Depths() = default;
+    explicit Depths(size_t size) : _nibbles((size + 1) / 2, 0xff), _size(size) {}
+
+    /*
+        Queries:
+    */
+
+    auto size() const -> size_t { return _size; }
+
+    int operator[](size_t i) const { return _nibbles[i / 2] >> (i % 2 * 4) & 0xf; }
+
+    /*
+        Commands:
+    */
+
+    void set(size_t i, int depth)
+    {
+        auto &nibbles = _nibbles[i / 2];
+        nibbles = (uint8_t)((nibbles & (0xf0 >> (i % 2 * 4))) | depth << (i % 2 * 4));
+    }
+
+  private:
+    vector<uint8_t> _nibbles;
+    size_t _size = 0;
+};
+
+template <size_t N> int rank(array<uint8_t, N> const &permutation)
+{
+    int rank = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        int smaller = 0;
+        for (size_t j = i + 1; j < N; j++)
+            smaller += permutation[j] < permutation[i];
+        rank = rank * (int)(N - i) + smaller;
+    }
+    return rank;
+}
+
+template <size_t N> array<uint8_t, N> unrank(int rank)
+{
+    array<int, N> digits;
+    for (size_t i = N; i-- > 0;)
+    {
+        digits[i] = rank % (int)(N - i);
+        rank /= (int)(N - i);
+    }
+    vector<uint8_t> left;
+    for (size_t i = 0; i < N; i++)
+        left.push_back((uint8_t)i);
+    array<uint8_t, N> permutation;
+    for (size_t i = 0; i < N; i++)
+    {
+        permutation[i] = left[digits[i]];
+        left.erase(left.begin() + digits[i]);
+    }
+    return permutation;
+}
+
+struct Tables {
+    // The edge slots in the slice between UP and DOWN, and the others; an edge's index within its group
+    array<int, 4> slice_slots;
+    array<int, 8> ud_slots;
+    array<bool, 12> in_slice;
+    array<uint8_t, 12> index;
+
+    // Which 4 of the 12 edge slots hold the slice edges, as a bit mask, ranked
+    array<int16_t, 4096> slice_rank;
+    array<uint16_t, SLICES> slice_mask;
+    int slice_goal;
+
+    array<int, PHASE2_MOVES> phase2; // the moves of phase 2
+
+    // Coordinate after a move: [coordinate * moves + move], with the phase 2 moves by their index in phase2
+    vector<uint16_t> twist_move, flip_move, slice_move;
+    vector<uint16_t> cperm_move, udperm_move, sliceperm_move;
+
+    // Moves to the goal of the phase, at least: [first * size of second + second]
+    Depths twist_slice, flip_slice;
+    Depths cperm_sliceperm, udperm_sliceperm;
+
+    // Moves to solved, at least, by any moves: corner permutation [cperm], and orientations [twist * FLIPS + flip]
+    Depths corners, twist_flip;
+
+    int twist(Cubies const &c) const
+    {
+        int twist = 0;
+        for (size_t i = 7; i-- > 0;)
+            twist = twist * 3 + c.co[i];
+        return twist;
+    }
+
+    int flip(Cubies const &c) const
+    {
+        int flip = 0;
+        for (size_t i = 11; i-- > 0;)
+            flip = flip * 2 + c.eo[i];
+        return flip;
+    }
+
+    int slice(Cubies const &c) const
+    {
+        int mask = 0;
+        for (size_t i = 0; i < 12; i++)
+            mask |= in_slice[c.ep[i]] << i;
+        return slice_rank[mask];
+    }
+
+    int cperm(Cubies const &c) const { return rank(c.cp); }
+
+    int udperm(Cubies const &c) const
+    {
+        array<uint8_t, 8> permutation;
+        for (size_t k = 0; k < 8; k++)
+            permutation[k] = index[c.ep[ud_slots[k]]];
+        return rank(permutation);
+    }
+
+    int sliceperm(Cubies const &c) const
+    {
+        array<uint8_t, 4> permutation;
+        for (size_t k = 0; k < 4; k++)
+            permutation[k] = index[c.ep[slice_slots[k]]];
+        return rank(permutation);
+    }
+
+    int phase1_bound(int twist, int flip, int slice) const
+    {
+        return max(twist_slice[twist * SLICES + slice], flip_slice[flip * SLICES + slice]);
+    }
+
+    int phase2_bound(int cperm, int udperm, int sliceperm) const
+    {
+        return max(cperm_sliceperm[cperm * SLICEPERMS + sliceperm], udperm_sliceperm[udperm * SLICEPERMS + sliceperm]);
+    }
+
+    int distance_bound(Cubies const &c) const
+    {
+        int twist = this->twist(c), flip = this->flip(c);
+        return max(max(phase1_bound(twist, flip, slice(c)), twist_flip[twist * FLIPS + flip]), corners[cperm(c)]);
+    }
+};
+
+// The coordinate after each move, of a state made up for each value of the coordinate
+template <typename Make, typename Coordinate>
+vector<uint16_t> move_table(int size, vector<int> const &moves, Make make, Coordinate coordinate)
+{
+    vector<uint16_t> table(size * moves.size());
+    for (int value = 0; value < size; value++)
+    {
+        auto state = make(value);
+        for (size_t k = 0; k < moves.size(); k++)
+            table[value * moves.size() + k] = (uint16_t)coordinate(state * cubies_of(moves[k]));
+    }
+    return table;
+}
+
+// Breadth-first from the goal over pairs of coordinates
+Depths pruning_table(int a_size, vector<uint16_t> const &a_move, int b_size, vector<uint16_t> const &b_move, int moves,
+                     int goal)
+{
+    Depths depth(a_size * b_size);
+    depth.set(goal, 0);
+    size_t seen = 1;
+    for (int d = 0; seen < depth.size(); d++)
+    {
+        for (int i = 0; i < a_size * b_size; i++)
+        {
+            if (depth[i] != d)
+                continue;
+            int a = i / b_size, b = i % b_size;
+            for (int m = 0; m < moves; m++)
+            {
+                int j = a_move[a * moves + m] * b_size + b_move[b * moves + m];
+                if (depth[j] == UNSEEN)
+                {
+                    depth.set(j, d + 1);
+                    seen++;
+                }
+            }
+        }
+    }
+    return depth;
+}
+
+Tables const &tables()
+{
+    static auto const tables = [] {
+        Tables t;
+
+        auto const &edges = Rubiks::edge_slots();
+        size_t n_slice = 0, n_ud = 0;
+        for (size_t i = 0; i < 12; i++)
+        {
+            auto face = edges[i][0] / 9 * 9;
+            t.in_slice[i] = face != Rubiks::UP && face != Rubiks::DOWN;
+            if (t.in_slice[i])
+            {
+                t.index[i] = (uint8_t)n_slice;
+                t.slice_slots[n_slice++] = (int)i;
+            }
+            else
+            {
+                t.index[i] = (uint8_t)n_ud;
+                t.ud_slots[n_ud++] = (int)i;
+            }
+        }
+
+        t.slice_rank.fill(-1);
+        int16_t rank = 0;
+        for (int mask = 0; mask < 4096; mask++)
+            if (__builtin_popcount(mask) == 4)
+            {
+                t.slice_mask[rank] = (uint16_t)mask;
+                t.slice_rank[mask] = rank++;
+            }
+        t.slice_goal = t.slice(Cubies());
+
+        vector<int> all, phase2;
+        for (int m = 0; m < MOVES; m++)
+        {
+            all.push_back(m);
+            auto face = face_of(m);
+            if (face == Rubiks::UP || face == Rubiks::DOWN || TURNS[m % 3] == 2)
+                phase2.push_back(m);
+        }
+        copy(phase2.begin(), phase2.end(), t.phase2.begin());
+
+        t.twist_move = move_table(TWISTS, all,
+                                  [](int value) {
+                                      Cubies c;
+                                      int twist = 0;
+                                      for (size_t i = 0; i < 7; i++, value /= 3)
+                                          twist += c.co[i] = (uint8_t)(value % 3);
+                                      c.co[7] = (uint8_t)((3 - twist % 3) % 3);
+                                      return c;
+                                  },
+                                  [&t](Cubies const &c) { return t.twist(c); });
+        t.flip_move = move_table(FLIPS, all,
+                                 [](int value) {
+                                     Cubies c;
+                                     int flip = 0;
+                                     for (size_t i = 0; i < 11; i++, value /= 2)
+                                         flip += c.eo[i] = (uint8_t)(value % 2);
+                                     c.eo[11] = (uint8_t)(flip % 2);
+                                     return c;
+                                 },
+                                 [&t](Cubies const &c) { return t.flip(c); });
+        t.slice_move = move_table(SLICES, all,
+                                  [&t](int value) {
+                                      Cubies c;
+                                      size_t s = 0, u = 0;
+                                      for (size_t i = 0; i < 12; i++)
+                                          c.ep[i] = (uint8_t)((t.slice_mask[value] >> i & 1) ? t.slice_slots[s++]
+                                                                                              : t.ud_slots[u++]);
+                                      return c;
+                                  },
+                                  [&t](Cubies const &c) { return t.slice(c); });
+        t.cperm_move = move_table(CPERMS, phase2,
+                                  [](int value) {
+                                      Cubies c;
+                                      c.cp = unrank<8>(value);
+                                      return c;
+                                  },
+                                  [&t](Cubies const &c) { return t.cperm(c); });
+        t.udperm_move = move_table(UDPERMS, phase2,
+                                   [&t](int value) {
+                                       Cubies c;
+                                       auto permutation = unrank<8>(value);
+                                       for (size_t k = 0; k < 8; k++)
+                                           c.ep[t.ud_slots[k]] = (uint8_t)t.ud_slots[permutation[k]];
+                                       return c;
+                                   },
+                                   [&t](Cubies const &c) { return t.udperm(c); });
+        t.sliceperm_move = move_table(SLICEPERMS, phase2,
+                                      [&t](int value) {
+                                          Cubies c;
+                                          auto permutation = unrank<4>(value);
+                                          for (size_t k = 0; k < 4; k++)
+                                              c.ep[t.slice_slots[k]] = (uint8_t)t.slice_slots[permutation[k]];
+                                          return c;
+                                      },
+                                      [&t](Cubies const &c) { return t.sliceperm(c); });
+
+        t.twist_slice = pruning_table(TWISTS, t.twist_move, SLICES, t.slice_move, MOVES, t.slice_goal);
+        t.flip_slice = pruning_table(FLIPS, t.flip_move, SLICES, t.slice_move, MOVES, t.slice_goal);
+        t.cperm_sliceperm = pruning_table(CPERMS, t.cperm_move, SLICEPERMS, t.sliceperm_move, PHASE2_MOVES, 0);
+        t.udperm_sliceperm = pruning_table(UDPERMS, t.udperm_move, SLICEPERMS, t.sliceperm_move, PHASE2_MOVES, 0);
+
+        auto corner_move = move_table(CPERMS, all,
+                                      [](int value) {
+                                          Cubies c;
+                                          c.cp = unrank<8>(value);
+                                          return c;
+                                      },
+                                      [&t](Cubies const &c) { return t.cperm(c); });
+        t.corners = pruning_table(CPERMS, corner_move, 1, vector<uint16_t>(MOVES, 0), MOVES, 0);
+        t.twist_flip = pruning_table(TWISTS, t.twist_move, FLIPS, t.flip_move, MOVES, 0);
+        return t;
+    }();
+    return tables;
+}
+
+class Search
+{
+  public:
+    Search(Cubies const &state, size_t max_length, uint64_t max_nodes, atomic<bool> const *stop)
+        : _t(tables()), _state(state), _max_length(max_length), _max_nodes(max_nodes), _stop(stop), _stopped(false),
+          _nodes(0), _depth1(0)
+    {
+    }
+
+    vector<Solver::Step> run()
+    {
+        int twist = _t.twist(_state), flip = _t.flip(_state), slice = _t.slice(_state);
+        for (_depth1 = _t.phase1_bound(twist, flip, slice); _depth1 <= (int)MAX_PHASE1; _depth1++)
+        {
+            if (phase1(twist, flip, slice, _depth1, NO_MOVE))
+                break;
+            if (!_best.empty() && (_depth1 + 1 >= (int)_best.size() || _nodes > _max_nodes))
+                break;
+        }
+
+        vector<Solver::Step> steps;
+        for (int move : _best)
+            steps.push_back(make_tuple(Solver::Turn, face_of(move), TURNS[move % 3]));
+        return steps;
+    }
+
+  private:
+    static constexpr size_t MAX_PHASE1 = 12; // always enough
+    static constexpr size_t MAX_PHASE2 = 18;
+    static constexpr uint64_t STOP_CHECK = 4095; // nodes between looks at the stop flag, less one
+
+    bool found() const { return !_best.empty(); }
+
+    // Counts a node; returns true once asked to stop, to unwind the search
+    bool visit()
+    {
+        if ((++_nodes & STOP_CHECK) == 0 && _stop != nullptr && _stop->load(memory_order_relaxed))
+            _stopped = true;
+        return _stopped;
+    }
+
+    // Returns true to stop searching
+    bool phase1(int twist, int flip, int slice, int depth, int last)
+    {
+        if (visit())
+            return true;
+        if (depth == 0)
+        {
+            // A phase-1 solution ending in a phase-2 move is a shorter one, tried already, with a detour
+            bool done = twist == 0 && flip == 0 && slice == _t.slice_goal;
+            return done && (last == NO_MOVE || find(_t.phase2.begin(), _t.phase2.end(), last) == _t.phase2.end()) &&
+                   phase2_from_here();
+        }
+        if (_t.phase1_bound(twist, flip, slice) > depth)
+            return false;
+
+        for (int m = 0; m < MOVES; m++)
+        {
+            if (redundant(m, last))
+                continue;
+            _moves.push_back(m);
+            if (phase1(_t.twist_move[twist * MOVES + m], _t.flip_move[flip * MOVES + m],
+                       _t.slice_move[slice * MOVES + m], depth - 1, m))
+                return true;
+            _moves.pop_back();
+        }
+        return false;
+    }
+
+    bool phase2_from_here()
+    {
+        Cubies state = _state;
+        for (int move : _moves)
+            state = state * cubies_of(move);
+        int cperm = _t.cperm(state), udperm = _t.udperm(state), sliceperm = _t.sliceperm(state);
+
+        int longest = found() ? (int)_best.size() - 1 - _depth1 : (int)MAX_PHASE2;
+        int last = _moves.empty() ? NO_MOVE : _moves.back();
+        for (int depth = _t.phase2_bound(cperm, udperm, sliceperm); depth <= longest; depth++)
+        {
+            if (phase2(cperm, udperm, sliceperm, depth, last))
+            {
+                if (_stopped)
+                    return true;
+                _best = _moves;
+                _moves.resize(_depth1);
+                return _best.size() <= _max_length || _nodes > _max_nodes;
+            }
+        }
+        return found() && _nodes > _max_nodes;
+    }
+
+    bool phase2(int cperm, int udperm, int sliceperm, int depth, int last)
+    {
+        if (visit())
+            return true;
+        if (depth == 0)
+            return cperm == 0 && udperm == 0 && sliceperm == 0;
+        if (_t.phase2_bound(cperm, udperm, sliceperm) > depth)
+            return false;
+
+        for (int k = 0; k < PHASE2_MOVES; k++)
+        {
+            int m = _t.phase2[k];
+            if (redundant(m, last))
+                continue;
+            _moves.push_back(m);
+            if (phase2(_t.cperm_move[cperm * PHASE2_MOVES + k], _t.udperm_move[udperm * PHASE2_MOVES + k],
+                       _t.sliceperm_move[sliceperm * PHASE2_MOVES + k], depth - 1, m))
+                return true;
+            _moves.pop_back();
+        }
+        return false;
+    }
+
+    Tables const &_t;
+    Cubies _state;
+    size_t _max_length;
+    uint64_t _max_nodes;
+    atomic<bool> const *_stop;
+    bool _stopped;
+    uint64_t _nodes;
+    int _depth1;        // of the phase-1 solutions searched for
+    vector<int> _moves; // so far
+    vector<int> _best;  // shortest solution so far
+};
+
+constexpr size_t Search::MAX_PHASE1;
+constexpr size_t Search::MAX_PHASE2;
+constexpr uint64_t Search::STOP_CHECK;
+
+} // namespace
+
+namespace twophase {
+
+vector<Solver::Step> solve(Cubies const &state, size_t max_length, uint64_t max_nodes, atomic<bool> const *stop)
+{
+    return Search(state, max_length, max_nodes, stop).run();
+}
+
+int distance_lower_bound(Cubies const &state) { return tables().distance_bound(state); }
+
+void prepare() { tables(); }
+
+} // namespace twophase
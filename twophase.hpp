@@ -0,0 +1,39 @@
+#pragma once
+
+#include "cubie.hpp"
+#include "solver.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Kociemba's two-phase algorithm, see https://kociemba.org/cube.htm
+//
+// Phase 1 takes the cube into the subgroup generated by U, D, R2, L2, F2, B2 (UP/DOWN turns and half turns of the
+// other faces): no corner twisted, no edge flipped, and the slice edges between UP and DOWN in that slice. Phase 2
+// solves it using those moves only. Both are iterative-deepening searches on coordinates of the cubie state, with move
+// tables for the coordinates and pruning tables (distance to the goal of a phase, per pair of coordinates) to cut
+// branches that can't make it. Trying longer phase-1 solutions for shorter totals, it finds solutions of about 20
+// turns of a random state in some 60 ms on a PC (the median; up to twice that), and many times that on the brick.
+//
+// The tables take about 6 MB, 4.3 of which are pruning depths packed in 4 bits each, and are built on first use,
+// which takes a while (seconds on the brick).
+//
+namespace twophase {
+
+constexpr std::size_t MAX_LENGTH = 20;       // good enough to stop at
+constexpr std::uint64_t MAX_NODES = 5000000; // to search for a solution of MAX_LENGTH, before settling for longer
+
+// Turns that solve the state: the shortest found by the time one is short enough, or the node budget is spent (but
+// the first one found in any case). Stops early once *stop is set, with the shortest found so far, or none.
+auto solve(Cubies const &state, std::size_t max_length = MAX_LENGTH, std::uint64_t max_nodes = MAX_NODES,
+           std::atomic<bool> const *stop = nullptr) -> std::vector<Solver::Step>;
+
+// Turns it takes at least to solve the state: the most that tables of its corner permutation, of its corner twist and
+// edge flip, and of either with the slice edges' slots tell. A few dozen nanoseconds, once the tables are built.
+auto distance_lower_bound(Cubies const &state) -> int;
+
+// Builds the tables, if not yet built
+void prepare();
+
+} // namespace twophase
@@ -1,41 +1,217 @@
 #include "worker.hpp"
+#include "classifier.hpp"
 #include "device.hpp"
+#include "queue.hpp"
 #include "rubiks.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <exception>
+#include <set>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
 
 #include <iostream>
 
 using namespace std;
 
-void scan(Rubiks &cube, Device &crawler)
+namespace {
+
+constexpr size_t STAGES_AHEAD = 4; // stages the solver may be ahead of the device
+
+// Can all faces in todo be scanned one after the other, starting next to face, with a single flip in between?
+bool in_a_row(Rubiks::Face face, set<Rubiks::Face> const &todo)
 {
-    // TODO: implement
+    if (todo.empty())
+        return true;
+
+    for (auto next : todo)
+    {
+        if (next == opposite_of(face))
+            continue;
+
+        auto rest = todo;
+        rest.erase(next);
+        if (in_a_row(next, rest))
+            return true;
+    }
+    return false;
+}
+
+// Table turns that bring a side of the device to the scanner's side (RIGHT), from where a flip brings it up
+int turns_to_right(Device::Face face)
+{
+    switch (face)
+    {
+    case Device::FRONT:
+        return -1;
+    case Device::BACK:
+        return 1;
+    case Device::LEFT:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+void scan(Rubiks &cube, Device &crawler, std::function<bool()> const &interrupted)
+{
+    auto start = crawler.now();
+
+    // Each face is brought up with a single flip: the scan of the face before turns the next one towards the scanner
+    // on the way. That works as long as the next face isn't at the bottom, and mostly with no extra table turns.
+    Readings readings = {};
+    set<Rubiks::Face> todo = {Rubiks::LEFT, Rubiks::RIGHT, Rubiks::BACK, Rubiks::FRONT, Rubiks::DOWN, Rubiks::UP};
+    while (!todo.empty())
+    {
+        if (interrupted()) // the crawler doesn't bring the faces up anymore
+            return;
+
+        Rubiks::Face up = Rubiks::UP;
+        for (auto const &entry : crawler.permutation())
+        {
+            if (entry.second == Device::UP)
+                up = entry.first;
+        }
+        todo.erase(up);
+
+        bool found = false;
+        int n = 0;
+        for (auto face : todo)
+        {
+            auto rest = todo;
+            rest.erase(face);
+            auto at = crawler.permutation().at(face);
+            if (at == Device::DOWN || !in_a_row(face, rest))
+                continue;
+            if (!found || abs(turns_to_right(at)) < abs(n))
+            {
+                found = true;
+                n = turns_to_right(at);
+            }
+        }
+
+        crawler.scan(readings, n);
+
+        if (found)
+            crawler.flip();
+        else if (!todo.empty()) // only when starting out of order
+            crawler.down(crawler.permutation().at(opposite_of(*todo.begin())));
+    }
+
+    // Facelets that couldn't be read well are inferred; only those that could still be another color are read again,
+    // the ones on the face that is up first, as they need no flip
+    auto classifying = chrono::steady_clock::now();
+    auto result = classify(readings);
+    auto classify_time = chrono::steady_clock::now() - classifying;
+    size_t rescanned = 0;
+    for (int round = 0; round < 2 && !result.ambiguous.empty(); round++)
+    {
+        auto up = crawler.permutation();
+        stable_partition(result.ambiguous.begin(), result.ambiguous.end(), [&up](int pos) {
+            return up.at((Rubiks::Face)(pos / 9 * 9)) == Device::UP;
+        });
+        for (auto pos : result.ambiguous)
+        {
+            if (interrupted())
+                return;
+            crawler.rescan(readings, pos);
+        }
+        rescanned += result.ambiguous.size();
+
+        classifying = chrono::steady_clock::now();
+        result = classify(readings);
+        classify_time += chrono::steady_clock::now() - classifying;
+    }
+    cube = result.cube;
+    auto scanned = crawler.now();
+
+    auto scan_time = chrono::duration_cast<chrono::milliseconds>(scanned - start);
+    auto classify_us = chrono::duration_cast<chrono::microseconds>(classify_time);
+    cout << "scanned in " << scan_time.count() / 1000.0 << " s";
+    if (rescanned > 0)
+        cout << " (" << rescanned << " facelets again)";
+    cout << ", classified in " << classify_us.count() / 1000.0 << " ms:\n" << cube << "\n";
 }
 
 void run(vector<Solver::Step> const &steps, Device &crawler, std::function<bool()> const &interrupted)
 {
     for (auto step : steps)
     {
-        cout << step;
-
         Solver::Operation op;
         Rubiks::Face face;
         int n;
         tie(op, face, n) = step;
 
+        // Once interrupted, the rotations are still followed: they only rename the faces, and so the crawler keeps
+        // naming them as the model does
+        if (op == Solver::Rotate) // only reorients the model, no need to move the cube physically
+        {
+            if (!interrupted())
+                cout << step;
+            crawler.rotate(face, n);
+            continue;
+        }
+
         if (interrupted())
-            break;
+            continue;
+        cout << step;
 
         auto const &cube_to_device_face_map = crawler.permutation();
         crawler.down(cube_to_device_face_map.at(face));
 
         if (interrupted())
-            break;
+            continue;
 
         //        cout << "check correct face is down and press enter\n";
         //        cin.ignore();
 
-        crawler.turn(n * -1, op != Solver::Rotate); // cube ccw <=> table cw
+        crawler.turn(n * -1, true); // cube ccw <=> table cw
     }
+
+    crawler.flush(); // if interrupted, this drops what is left and takes it back out of the crawler's state
+}
+
+void solve(Solver const &solver, Rubiks &cube, Device &crawler, std::function<bool()> const &interrupted,
+           Solver::Emit const &on_steps)
+{
+    BoundedQueue<vector<Solver::Step>> stages(STAGES_AHEAD);
+    exception_ptr failure;
+
+    thread runner([&] {
+        try
+        {
+            vector<Solver::Step> steps;
+            while (stages.pop(steps))
+            {
+                if (on_steps && !interrupted())
+                    on_steps(steps);
+                run(steps, crawler, interrupted); // once interrupted, only the rotations
+            }
+        }
+        catch (...)
+        {
+            failure = current_exception();
+        }
+        stages.close(); // the solver needn't wait for room anymore
+    });
+
+    try
+    {
+        solver.solve(cube, [&stages](vector<Solver::Step> const &steps) { stages.push(steps); });
+    }
+    catch (...)
+    {
+        stages.close();
+        runner.join();
+        throw;
+    }
+    stages.close();
+    runner.join();
+
+    if (failure)
+        rethrow_exception(failure);
 }
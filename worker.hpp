@@ -7,8 +7,15 @@
 class Rubiks;
 class Device;
 
-// Scan and init cube as it is on the device
-void scan(Rubiks &cube, Device &crawler);
+// Scan and init cube as it is on the device; once interrupted, the scan stops and leaves cube as it was
+void scan(Rubiks &cube, Device &crawler, std::function<bool()> const &interrupted);
 
-// Apply the given steps to the cube on the device
+// Apply the given steps to the cube on the device; once interrupted, only the rotations (which move nothing), and
+// motions already planned are dropped and taken back out of the device's state
 void run(std::vector<Solver::Step> const &steps, Device &crawler, std::function<bool()> const &interrupted);
+
+// Solve the cube and apply the solution to the cube on the device at the same time: the steps of each stage the
+// solver commits to are run (on a thread of their own) while it works on the next. Stages wait in a bounded queue;
+// on_steps, if any, is called with each of them right before it runs.
+void solve(Solver const &solver, Rubiks &cube, Device &crawler, std::function<bool()> const &interrupted,
+           Solver::Emit const &on_steps = nullptr);